@@ -0,0 +1,597 @@
+/* Headless benchmark of the boids simulation core
+ * Runs the flock from core/boids_core.h without opening a window, and prints
+ * the average time per step of every phase. The world is scaled with the boid
+ * count, so that the density (and thus the neighbour count) stays the same as
+ * in the game.
+ *
+ * usage : ./boids_bench [boid count] [steps] [max threads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "core/boids_core.h"
+
+#define BENCH_DT (1.0f / 60.0f)
+
+struct BenchResult
+{
+    double grid_ms = 0.0;
+    double steer_ms = 0.0;
+    double move_ms = 0.0;
+    double hunt_ms = 0.0;
+    double heat_ms = 0.0;
+    double busy_ms = 0.0;   // thread pool only, per worker average
+    double idle_ms = 0.0;   // thread pool only, per worker average
+    double imbalance = 0.0; // thread pool only, busiest worker over average worker
+    long long heap_allocations = 0; // summed over all steps, when built with BOIDS_COUNT_ALLOCATIONS
+    double migrated = 0.0;          // incremental grid only, per step
+};
+
+static const char *BACKEND_NAMES[] = {"serial", "openmp", "pool", "stdpar"};
+
+// backends compiled into this build
+bool BackendAvailable(int backend)
+{
+    (void) backend; // when every backend is compiled in
+#ifndef _OPENMP
+    if (backend == BACKEND_OPENMP)
+        return false;
+#endif
+#ifndef BOIDS_STD_EXECUTION
+    if (backend == BACKEND_STD_PAR)
+        return false;
+#endif
+    return true;
+}
+
+// thread counts to try for a backend: serial is 1, std::execution picks its own (0, printed as "auto")
+std::vector<int> ThreadCounts(int backend, int max_threads)
+{
+    if (backend == BACKEND_SERIAL)
+        return {1};
+    if (backend == BACKEND_STD_PAR)
+        return {0};
+    std::vector<int> counts;
+    for (int threads = 1; threads <= max_threads; threads *= 2)
+        counts.push_back(threads);
+    return counts;
+}
+
+const char *ThreadLabel(int threads)
+{
+    static char label[16];
+    if (threads > 0)
+        snprintf(label, sizeof(label), "%d", threads);
+    else
+        snprintf(label, sizeof(label), "auto");
+    return label;
+}
+
+// run `steps` steps from the given flock, and return the average per-step timings
+BenchResult RunSteps(std::vector<Boid> &boids, int steps, const uint8_t *species = nullptr)
+{
+    SpatialGrid grid;
+    BenchResult r;
+    for (int s = 0; s < steps; s++)
+    {
+        StepFlock(boids, grid, NO_MOUSE, BENCH_DT, nullptr, species);
+        r.grid_ms += Stats::grid_ms;
+        r.steer_ms += Stats::steer_ms;
+        r.move_ms += Stats::move_ms;
+        r.hunt_ms += Stats::hunt_ms;
+        r.heat_ms += Stats::heat_ms;
+        r.heap_allocations += Stats::heap_allocations;
+        r.migrated += Stats::grid_migrated;
+        int workers = (int) Stats::worker_busy_ms.size();
+        if (workers > 0)
+        {
+            double busy = 0.0, idle = 0.0, max_busy = 0.0;
+            for (int w = 0; w < workers; w++)
+            {
+                busy += Stats::worker_busy_ms[w];
+                idle += Stats::worker_idle_ms[w];
+                max_busy = Stats::worker_busy_ms[w] > max_busy ? Stats::worker_busy_ms[w] : max_busy;
+            }
+            r.busy_ms += busy / workers;
+            r.idle_ms += idle / workers;
+            r.imbalance += busy > 0 ? max_busy / (busy / workers) : 1.0;
+        }
+    }
+    r.grid_ms /= steps;
+    r.steer_ms /= steps;
+    r.move_ms /= steps;
+    r.hunt_ms /= steps;
+    r.heat_ms /= steps;
+    r.busy_ms /= steps;
+    r.idle_ms /= steps;
+    r.imbalance /= steps;
+    r.migrated /= steps;
+    return r;
+}
+
+// average time of a grid build alone over `steps` builds, and whether it matched the serial build
+double BenchGridBuild(const std::vector<Boid> &boids, int steps, const SpatialGrid &reference, bool *same)
+{
+    SpatialGrid grid;
+    double total = 0.0;
+    for (int s = 0; s < steps; s++)
+    {
+        double t0 = NowMs();
+        BuildGrid(boids, grid, MakeTickParams(NO_MOUSE, BENCH_DT));
+        total += NowMs() - t0;
+        frame_arena.Reset();
+    }
+    *same = grid.items == reference.items && grid.cell_start == reference.cell_start;
+    return total / steps;
+}
+
+void PrintResult(const char *name, int threads, const BenchResult &r)
+{
+    printf("%-10s %7s %9.3f %9.3f %9.3f %9.3f", name, ThreadLabel(threads), r.grid_ms, r.steer_ms, r.move_ms,
+           r.grid_ms + r.steer_ms + r.move_ms);
+    if (r.imbalance > 0)
+        printf(" %9.3f %9.3f %9.2f", r.busy_ms, r.idle_ms, r.imbalance);
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 10000;
+    int steps = argc > 2 ? atoi(argv[2]) : 200;
+    int max_threads = argc > 3 ? atoi(argv[3]) : ThreadCount();
+    if (count < 1 || steps < 1 || max_threads < 1)
+    {
+        fprintf(stderr, "usage : %s [boid count] [steps] [max threads]\n", argv[0]);
+        return 1;
+    }
+
+    float scale = sqrtf((float) count / BOID_COUNT);
+    Settings::world_width = WORLD_WIDTH * scale;
+    Settings::world_height = WORLD_HEIGHT * scale;
+    srand(1);
+    std::vector<Boid> start;
+    SpawnFlock(start, count);
+    printf("%d boids, world %.0f x %.0f, %d steps\n\n", count, Settings::world_width, Settings::world_height, steps);
+
+    // --- grid build alone, serial counting sort vs parallel radix sort ---
+    SpatialGrid reference;
+    reference.Build(start, Settings::world_width, Settings::world_height, Settings::perception_radius);
+    printf("%-10s %7s %9s\n", "grid", "threads", "build ms");
+    for (int backend = BACKEND_SERIAL; backend <= BACKEND_STD_PAR; backend++)
+    {
+        if (!BackendAvailable(backend))
+            continue;
+        Settings::backend = backend;
+        for (int threads : ThreadCounts(backend, max_threads))
+        {
+            Settings::threads = threads;
+            bool same;
+            double ms = BenchGridBuild(start, steps, reference, &same);
+            printf("%-10s %7s %9.3f%s\n", BACKEND_NAMES[backend], ThreadLabel(threads), ms, same ? "" : "  MISMATCH");
+        }
+    }
+    printf("\n");
+
+    printf("%-10s %7s %9s %9s %9s %9s %9s %9s %9s\n", "backend", "threads", "grid ms", "steer ms", "move ms",
+           "total ms", "busy ms", "idle ms", "imbalance");
+
+    // --- backends x thread counts ---
+    for (int backend = BACKEND_SERIAL; backend <= BACKEND_STD_PAR; backend++)
+    {
+        if (!BackendAvailable(backend))
+            continue;
+        Settings::backend = backend;
+        for (int threads : ThreadCounts(backend, max_threads))
+        {
+            Settings::threads = threads;
+            std::vector<Boid> boids = start;
+            PrintResult(BACKEND_NAMES[backend], threads, RunSteps(boids, steps));
+        }
+    }
+    Settings::backend = BACKEND_POOL;
+    Settings::threads = max_threads;
+
+    // --- scratch memory ---
+    std::vector<Boid> boids = start;
+    BenchResult r = RunSteps(boids, steps);
+    printf("\nframe arena : %.1f KB per step, high water %.1f KB, grew %d times", Stats::arena_kb,
+           Stats::arena_high_water_kb, frame_arena.Grows());
+#ifdef BOIDS_COUNT_ALLOCATIONS
+    printf("; %.2f heap allocations per step", (double) r.heap_allocations / steps);
+#else
+    (void) r;
+#endif
+    printf("\n");
+
+    // --- grid maintenance: full rebuild vs incremental, at the default speed and for a slow flock ---
+    printf("\n%-10s %7s %9s %9s %9s %9s %9s\n", "grid", "speed", "grid ms", "steer ms", "move ms", "total ms",
+           "migrated");
+    float default_speed = Settings::max_speed;
+    for (float speed : {default_speed, default_speed / 5})
+    {
+        Settings::max_speed = speed;
+        for (bool incremental : {false, true})
+        {
+            Settings::incremental_grid = incremental;
+            std::vector<Boid> boids = start;
+            BenchResult r = RunSteps(boids, steps);
+            printf("%-10s %7.2f %9.3f %9.3f %9.3f %9.3f", incremental ? "increment." : "rebuild", speed, r.grid_ms,
+                   r.steer_ms, r.move_ms, r.grid_ms + r.steer_ms + r.move_ms);
+            if (incremental)
+                printf(" %9.1f", r.migrated);
+            printf("\n");
+        }
+    }
+    Settings::max_speed = default_speed;
+    Settings::incremental_grid = false;
+
+    // --- staggered steering: each boid steered every `groups` steps, against steering every boid every step ---
+    // the flocks drift apart like any two runs that differ at all (see approx vs exact), so what is compared is the
+    // force each boid flies with against a fresh one, and the flock alignment (1 when all fly the same way)
+    printf("\n%-10s %7s %9s %9s %9s %9s %9s %9s %9s\n", "steering", "groups", "grid ms", "steer ms", "move ms",
+           "total ms", "force err", "order", "pos rms");
+    std::vector<Boid> full = start;
+    for (int groups : {1, 2, 4, 8})
+    {
+        Settings::steer_groups = groups;
+        Stats::steps = 0;
+        std::vector<Boid> boids = start;
+        BenchResult r = RunSteps(boids, steps);
+        if (groups == 1)
+            full = boids;
+        std::vector<Boid> fresh = boids;
+        SpatialGrid grid;
+        grid.Build(fresh, Settings::world_width, Settings::world_height, Settings::perception_radius);
+        ComputeSteering(fresh, grid, MakeTickParams(NO_MOUSE, BENCH_DT));
+        double err = 0.0, drift = 0.0;
+        Vector2 heading = {0, 0};
+        int measured = 0;
+        for (int i = 0; i < count; i++)
+        {
+            float ref = Vector2Length(fresh[i].acc);
+            if (ref > 0)
+            {
+                err += Vector2Length(boids[i].acc - fresh[i].acc) / ref;
+                measured++;
+            }
+            heading += Vector2Normalize(boids[i].vel);
+            drift += Vector2DistanceSqr(full[i].pos, boids[i].pos);
+        }
+        printf("%-10s %7d %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n", groups == 1 ? "full" : "staggered", groups,
+               r.grid_ms, r.steer_ms, r.move_ms, r.grid_ms + r.steer_ms + r.move_ms, measured ? err / measured : 0.0,
+               Vector2Length(heading) / count, sqrt(drift / count));
+    }
+    Settings::steer_groups = 1;
+    frame_arena.Reset();
+
+    // --- alignment and cohesion from cell sums, against pairwise, as the perception radius grows ---
+    printf("\n%-10s %7s %9s %9s %9s %9s %9s\n", "gather", "radius", "grid ms", "steer ms", "move ms", "total ms",
+           "force err");
+    float default_radius = Settings::perception_radius;
+    for (float radius : {default_radius, default_radius * 4, default_radius * 16})
+    {
+        Settings::perception_radius = radius;
+        std::vector<Boid> steered[2];
+        for (bool sums : {false, true})
+        {
+            Settings::cell_sums = sums;
+            std::vector<Boid> boids = start;
+            BenchResult r = RunSteps(boids, steps);
+            // steering of a single step, both gathers starting from the same flock
+            steered[sums] = start;
+            SpatialGrid grid;
+            TickParams params = MakeTickParams(NO_MOUSE, BENCH_DT);
+            BuildGrid(steered[sums], grid, params);
+            ComputeSteering(steered[sums], grid, params);
+            frame_arena.Reset();
+            printf("%-10s %7.0f %9.3f %9.3f %9.3f %9.3f", sums ? "cell sums" : "pairwise", radius, r.grid_ms,
+                   r.steer_ms, r.move_ms, r.grid_ms + r.steer_ms + r.move_ms);
+            if (sums)
+            {
+                double err = 0.0;
+                int measured = 0;
+                for (int i = 0; i < count; i++)
+                {
+                    float ref = Vector2Length(steered[0][i].acc);
+                    if (ref == 0)
+                        continue;
+                    err += Vector2Length(steered[1][i].acc - steered[0][i].acc) / ref;
+                    measured++;
+                }
+                printf(" %9.2e", measured ? err / measured : 0.0);
+            }
+            printf("\n");
+        }
+    }
+    Settings::perception_radius = default_radius;
+    Settings::cell_sums = false;
+
+    // --- species: the pair weights looked up per neighbour, against the single species gather ---
+    printf("\n%-10s %7s %9s %9s %9s %9s\n", "species", "count", "grid ms", "steer ms", "move ms", "total ms");
+    std::vector<uint8_t> species(count);
+    for (int n : {1, 2, 8, 32})
+    {
+        Settings::species = n;
+        for (int i = 0; i < count; i++)
+            species[i] = (uint8_t) (i % n);
+        std::vector<Boid> boids = start;
+        BenchResult r = RunSteps(boids, steps, species.data());
+        printf("%-10s %7d %9.3f %9.3f %9.3f %9.3f\n", n == 1 ? "single" : "matrix", n, r.grid_ms, r.steer_ms,
+               r.move_ms, r.grid_ms + r.steer_ms + r.move_ms);
+    }
+    // with every pair weighing the same, the species only split one flock: the forces must not change
+    {
+        std::vector<Boid> steered[2] = {start, start};
+        SpatialGrid grid;
+        for (int split : {0, 1})
+        {
+            Settings::species = split ? 4 : 1;
+            for (int i = 0; i < count; i++)
+                species[i] = (uint8_t) (i % Settings::species);
+            species_matrix.Reset(Settings::species);
+            for (int a = 0; a < Settings::species; a++)
+                for (int b = 0; b < Settings::species; b++)
+                    species_matrix.Set(a, b, 1, 1, 1);
+            TickParams params = MakeTickParams(NO_MOUSE, BENCH_DT);
+            BuildGrid(steered[split], grid, params);
+            ComputeSteering(steered[split], grid, params, 1, 0, nullptr, nullptr, split ? species.data() : nullptr);
+            frame_arena.Reset();
+        }
+        double err = 0.0;
+        for (int i = 0; i < count; i++)
+        {
+            float ref = Vector2Length(steered[0][i].acc);
+            if (ref > 0)
+                err = fmax(err, Vector2Length(steered[1][i].acc - steered[0][i].acc) / ref);
+        }
+        printf("one flock as 4 species : steering rel. error max %.2e\n", err);
+        species_matrix.Reset(1);
+    }
+    Settings::species = 1;
+
+    // --- predators: hunting and fear through the grids, the fear against a loop over every predator ---
+    printf("\n%-10s %7s %9s %9s %9s %9s %9s %9s\n", "predators", "count", "hunt ms", "steer ms", "total ms",
+           "fear ms", "O(P) ms", "fear err");
+    for (int n : {0, 10, 100, 500, 1000})
+    {
+        Settings::predator_count = n;
+        std::vector<Boid> boids = start;
+        BenchResult r = RunSteps(boids, steps);
+        // the fear of every boid from where the predators ended, through their grid and from all of them
+        TickParams params = MakeTickParams(NO_MOUSE, BENCH_DT);
+        std::vector<Vector2> fear(count), direct(count);
+        double t0 = NowMs();
+        for (int i = 0; i < count; i++)
+            fear[i] = predator_pack.Fear(boids[i].pos, params);
+        double t1 = NowMs();
+        float r2 = params.fear_radius * params.fear_radius;
+        for (int i = 0; i < count; i++)
+        {
+            Vector2 force = {0, 0};
+            for (const Boid &p : predator_pack.agents)
+            {
+                Vector2 diff = boids[i].pos - p.pos;
+                float d2 = diff.x * diff.x + diff.y * diff.y;
+                if (d2 < r2 && d2 > 0)
+                    force += diff * (1.0f / (sqrtf(d2) * (sqrtf(d2) + 0.001f)));
+            }
+            direct[i] = force * params.fear_push;
+        }
+        double t2 = NowMs();
+        double err = 0.0;
+        for (int i = 0; i < count; i++)
+            err = fmax(err, Vector2Length(direct[i] - fear[i]) / (Vector2Length(direct[i]) + 1e-6));
+        printf("%-10s %7d %9.3f %9.3f %9.3f %9.3f %9.3f %9.1e\n", "grid", n, r.hunt_ms, r.steer_ms,
+               r.grid_ms + r.hunt_ms + r.steer_ms + r.move_ms, t1 - t0, t2 - t1, err);
+    }
+    Settings::predator_count = 0;
+    predator_pack.Resize(0, Settings::world_width, Settings::world_height);
+
+    // --- obstacles: one distance field lookup per boid, against the distance to every obstacle ---
+    printf("\n%-10s %7s %9s %9s %9s %12s %9s\n", "obstacles", "count", "bake ms", "steer ms", "total ms", "direct ms",
+           "near");
+    for (int n : {0, 10, 100, 1000})
+    {
+        ObstacleSet set;
+        for (int k = 0; k < n; k++)
+            set.circles.push_back({{(float) (rand() % (int) Settings::world_width),
+                                    (float) (rand() % (int) Settings::world_height)},
+                                   (float) (20 + rand() % 60)});
+        world_obstacles.Set(set);
+        std::vector<Boid> boids = start;
+        BenchResult r = RunSteps(boids, steps);
+        // the signed distance of every boid, going through every obstacle as a per-boid test would
+        double t0 = NowMs();
+        int near = 0; // boids within reach of an obstacle at the end
+        for (int i = 0; i < count; i++)
+            near += set.Distance(boids[i].pos) < OBSTACLE_TOL;
+        double t1 = NowMs();
+        printf("%-10s %7d %9.3f %9.3f %9.3f %12.3f %9d\n", n ? "sdf" : "none", n, n ? Stats::sdf_ms : 0.0, r.steer_ms,
+               r.grid_ms + r.steer_ms + r.move_ms, t1 - t0, near);
+    }
+    world_obstacles.Set(ObstacleSet());
+
+    // --- wind: one flow grid lookup per boid, against evaluating the curl noise per boid ---
+    printf("\n%-10s %7s %9s %9s %9s %9s %9s %9s\n", "wind", "weight", "gen ms", "steer ms", "total ms", "lookup ns",
+           "noise ns", "max err");
+    for (float weight : {0.0f, 50.0f})
+    {
+        Settings::wind_weight = weight;
+        std::vector<Boid> boids = start;
+        BenchResult r = RunSteps(boids, steps);
+        // the wind on every boid where it ended, from a grid generated here and straight from the noise
+        FlowGrid wind;
+        std::vector<Vector2> looked(count), direct(count);
+        double t0 = NowMs();
+        wind.Generate(Settings::world_width, Settings::world_height, 1.0f);
+        double t1 = NowMs();
+        for (int i = 0; i < count; i++)
+            looked[i] = wind.Lookup(boids[i].pos);
+        double t2 = NowMs();
+        for (int i = 0; i < count; i++)
+            direct[i] = WindAt(boids[i].pos, 1.0f);
+        double t3 = NowMs();
+        float err = 0.0f;
+        for (int i = 0; i < count; i++)
+            err = fmaxf(err, Vector2Length(looked[i] - direct[i]));
+        printf("%-10s %7.0f %9.3f %9.3f %9.3f %9.2f %9.2f %9.3f\n", weight > 0 ? "grid" : "none", weight, t1 - t0,
+               r.steer_ms, r.grid_ms + r.steer_ms + r.move_ms, (t2 - t1) * 1e6 / count, (t3 - t2) * 1e6 / count, err);
+    }
+    Settings::wind_weight = 0.0f;
+
+    // --- goal: one path field search from the goal, spread over steps, then one lookup per boid ---
+    printf("\n%-10s %7s %9s %9s %9s %9s %9s %9s %9s\n", "goal", "obst", "nodes", "steps", "max ms", "search ms",
+           "lookup ns", "no way", "steer ms");
+    for (int n : {0, 100})
+    {
+        ObstacleSet set;
+        for (int k = 0; k < n; k++)
+            set.circles.push_back({{(float) (rand() % (int) Settings::world_width),
+                                    (float) (rand() % (int) Settings::world_height)},
+                                   (float) (20 + rand() % 60)});
+        ObstacleField obstacles;
+        obstacles.Set(set);
+        obstacles.Update(SDF_CELL, OBSTACLE_TOL + 2 * SDF_CELL);
+        // a search of its own, timed step by step, from a corner of the world
+        PathField path;
+        path.SetGoal({Settings::world_width / 8, Settings::world_height / 8});
+        int search_steps = 0;
+        double search_ms = 0.0, max_ms = 0.0;
+        const FlowGrid *field = nullptr;
+        do
+        {
+            double t0 = NowMs();
+            field = path.Update(obstacles.field.Empty() ? nullptr : &obstacles.field, obstacles.Baked(),
+                                Settings::world_width, Settings::world_height, PATH_BUDGET);
+            double ms = NowMs() - t0;
+            search_ms += ms;
+            max_ms = fmax(max_ms, ms);
+            search_steps++;
+        } while (path.Searching());
+        std::vector<Vector2> way(count);
+        double t0 = NowMs();
+        for (int i = 0; i < count; i++)
+            way[i] = field->Lookup(start[i].pos);
+        double t1 = NowMs();
+        int lost = 0; // boids the field gives no direction, inside obstacles with no way out
+        for (int i = 0; i < count; i++)
+            lost += way[i].x == 0 && way[i].y == 0;
+        // the flock following the same goal through world_goal
+        world_obstacles.Set(set);
+        world_goal.SetGoal({Settings::world_width / 8, Settings::world_height / 8});
+        std::vector<Boid> boids = start;
+        BenchResult r = RunSteps(boids, steps);
+        printf("%-10s %7d %9d %9d %9.3f %9.3f %9.2f %9d %9.3f\n", "field", n, field->cols * field->rows, search_steps,
+               max_ms, search_ms, (t1 - t0) * 1e6 / count, lost, r.steer_ms);
+    }
+    world_goal.ClearGoal();
+    world_obstacles.Set(ObstacleSet());
+
+    // --- heatmap: the density map from the cell counts of the grid, against splatting every boid again ---
+    printf("\n%-10s %7s %9s %9s %9s %9s\n", "heatmap", "grid", "cells", "grid ms", "heat ms", "splat ms");
+    Settings::heatmap = true;
+    for (bool incremental : {false, true})
+    {
+        Settings::incremental_grid = incremental;
+        std::vector<Boid> boids = start;
+        BenchResult r = RunSteps(boids, steps);
+        // the same update from a pass over the boids, as a map without the grid would need
+        DensityMap splat = flock_density;
+        std::vector<int> counts(splat.density.size());
+        float area = splat.cell_size * splat.cell_size, blend = 1.0f - expf(-BENCH_DT / HEAT_TAU);
+        double t0 = NowMs();
+        std::fill(counts.begin(), counts.end(), 0);
+        for (const Boid &b : boids)
+        {
+            int cx = std::min(std::max((int) ((b.pos.x - splat.origin_x) / splat.cell_size), 0), splat.cols - 1);
+            int cy = std::min(std::max((int) ((b.pos.y - splat.origin_y) / splat.cell_size), 0), splat.rows - 1);
+            counts[cy * splat.cols + cx]++;
+        }
+        for (size_t c = 0; c < counts.size(); c++)
+            splat.density[c] += (counts[c] / area - splat.density[c]) * blend;
+        double t1 = NowMs();
+        printf("%-10s %7s %9d %9.3f %9.3f %9.3f\n", "counts", incremental ? "linked" : "sorted",
+               flock_density.cols * flock_density.rows, r.grid_ms, r.heat_ms, t1 - t0);
+    }
+    Settings::heatmap = false;
+    Settings::incremental_grid = false;
+
+    // --- long-range term: Barnes-Hut quadtree as the flock grows, against the direct sum over every boid ---
+    printf("\n%-10s %9s %9s %9s %12s %9s\n", "quadtree", "boids", "build ms", "query ms", "ns/N log N", "force err");
+    Settings::long_range_weight = 1.0f;
+    for (int n = 10000; n <= 1000000; n *= 10)
+    {
+        float s = sqrtf((float) n / BOID_COUNT);
+        Settings::world_width = WORLD_WIDTH * s;
+        Settings::world_height = WORLD_HEIGHT * s;
+        TickParams params = MakeTickParams(NO_MOUSE, BENCH_DT);
+        std::vector<Boid> flock;
+        SpawnFlock(flock, n);
+        Quadtree tree;
+        double t0 = NowMs();
+        tree.Build(flock, Settings::world_width, Settings::world_height);
+        double t1 = NowMs();
+        std::vector<Vector2> force(n);
+        // in tree order, so that consecutive queries walk the same nodes (the step walks them in grid order)
+        ParallelFor(0, n, BOID_CHUNK, [&](int begin, int end, int) {
+            for (int k = begin; k < end; k++)
+                force[tree.order[k]] = LongRangeForce(flock, tree, tree.order[k], params, params.theta);
+        });
+        double t2 = NowMs();
+        // theta = 0 opens every node down to the boids, i.e. the direct sum; on a sample, it is O(N) per boid
+        double err = 0.0;
+        int measured = 0;
+        for (int i = 0; i < n; i += n / 256)
+        {
+            Vector2 exact = LongRangeForce(flock, tree, i, params, 0.0f);
+            if (Vector2Length(exact) == 0)
+                continue;
+            err += Vector2Length(force[i] - exact) / Vector2Length(exact);
+            measured++;
+        }
+        printf("%-10s %9d %9.3f %9.3f %12.3f %9.2e\n", "theta", n, t1 - t0, t2 - t1,
+               (t1 - t0 + t2 - t1) * 1e6 / (n * log2((double) n)), measured ? err / measured : 0.0);
+    }
+    Settings::long_range_weight = 0.0f;
+    Settings::world_width = WORLD_WIDTH * scale;
+    Settings::world_height = WORLD_HEIGHT * scale;
+
+    // --- exact vs approximate math ---
+    printf("\n");
+    std::vector<Boid> exact = start, approx = start;
+    Settings::approx_math = false;
+    PrintResult("exact", max_threads, RunSteps(exact, steps));
+    Settings::approx_math = true;
+    PrintResult("approx", max_threads, RunSteps(approx, steps));
+
+    // steering error of a single step, both paths starting from the same flock
+    std::vector<Boid> a = start, b = start;
+    SpatialGrid grid;
+    grid.Build(start, Settings::world_width, Settings::world_height, Settings::perception_radius);
+    Settings::approx_math = false;
+    ComputeSteering(a, grid, MakeTickParams(NO_MOUSE, BENCH_DT));
+    Settings::approx_math = true;
+    ComputeSteering(b, grid, MakeTickParams(NO_MOUSE, BENCH_DT));
+    Settings::approx_math = false;
+    double max_err = 0.0, sum_err = 0.0;
+    int measured = 0;
+    for (int i = 0; i < count; i++)
+    {
+        float ref = Vector2Length(a[i].acc);
+        if (ref == 0)
+            continue;
+        double err = Vector2Length(b[i].acc - a[i].acc) / ref;
+        max_err = err > max_err ? err : max_err;
+        sum_err += err;
+        measured++;
+    }
+    // and how far apart the two flocks drifted over the whole run
+    double drift = 0.0;
+    for (int i = 0; i < count; i++)
+        drift += Vector2DistanceSqr(exact[i].pos, approx[i].pos);
+    printf("\napprox vs exact : steering rel. error max %.2e, mean %.2e; position rms after %d steps %.3f\n",
+           max_err, measured ? sum_err / measured : 0.0, steps, sqrt(drift / count));
+    return 0;
+}
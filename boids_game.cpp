@@ -10,103 +10,73 @@
 #include <vector>
 #define RAYGUI_IMPLEMENTATION
 
+#include "core/boids_core.h"
+#include "core/pipeline.h"
 #include "lib/raygui.h"
 
 #define WIDTH 1000
 #define HEIGHT 700
-#define WORLD_WIDTH 2000
-#define WORLD_HEIGHT 2000
-#define BOID_COUNT 600  // total boids
-#define MOUSE_CONST 100 // a constant to scale mouse_weight
-#define WALL_CONST 100  // a constant to scale wall_weight
-#define WALL_TOL 100.0f // distance at which wall starts exerting force
-#define TRI_DIM 5.0f    // length from center to vertice of boid triangle
+#define MENU_HEIGHT 1150 // height of the settings, the panel scrolls when the window is shorter
 #define CAMERA_SPEED 1000.0f
+#define FLOCK_CAPACITY (BOID_COUNT * 20)
+#define SPAWN_BURST 20         // boids spawned per click
+#define DESPAWN_RADIUS 60.0f   // around the mouse, on right click
+#define OBSTACLE_RADIUS 60.0f  // of the obstacles placed with a middle click
+#define OBSTACLE_FILE "obstacles.txt" // loaded at start, when there is one
+#define GOAL_RADIUS 20.0f      // of the goal marker, G over it clears the goal
 
-// namespace to hold all config information
+// the simulation settings live in core/boids_core.h, these only drive the GUI
 namespace Settings
 {
-// --- BOID CONTROL ---
-float perception_radius = 50.0f;
-float max_speed = 2.5f;
-float sep_weight = 100.0f;
-float ali_weight = 50.0f;
-float coh_weight = 40.0f;
-float mouse_weight = 50.0f;
-float wall_weight = 50.0f;
-bool WrapAroundWorld = false;
-// --- ---
 // --- Settings window params ---
 bool menuActive = false;
 float menuWidth = 250.0f;
 float currentOffset = 0.0f;
+Vector2 menuScroll = {0, 0};
+bool showStats = true;
+bool pipelined = false; // simulate on a separate thread, one tick ahead of the one being drawn
 // --- ---
 }; // namespace Settings
 
-// vertices in clock-wise order
-typedef struct triangle_vertices
-{
-    Vector2 v1;
-    Vector2 v2;
-    Vector2 v3;
-} Triangle;
-
-class Boid
-{
-  public:
-    Vector2 pos;
-    Vector2 vel;
-    Triangle vertices;
-    Boid() {};
-    void UpdateTriangle()
-    {
-        Vector2 dir = Vector2Scale(Vector2Normalize(vel), TRI_DIM);
-        vertices.v1 = pos + dir;
-        dir = Vector2Rotate(dir, 120 * DEG2RAD);
-        vertices.v2 = pos + dir;
-        dir = Vector2Rotate(dir, 120 * DEG2RAD);
-        vertices.v3 = pos + dir;
-    }
-    void WrapAroundWorld()
-    {
-        if (pos.x > WORLD_WIDTH)
-            pos.x -= WORLD_WIDTH;
-        if (pos.y > WORLD_HEIGHT)
-            pos.y -= WORLD_HEIGHT;
-        if (pos.x < 0)
-            pos.x += WORLD_WIDTH;
-        if (pos.y < 0)
-            pos.y += WORLD_HEIGHT;
-    }
-    void ClampToWorld()
-    {
-        if (pos.x > WORLD_WIDTH)
-            pos.x = WORLD_WIDTH;
-        else if (pos.x < 0)
-            pos.x = 0;
-        if (pos.y > WORLD_HEIGHT)
-            pos.y = WORLD_HEIGHT;
-        if (pos.y < 0)
-            pos.y = 0;
-    }
-};
+// mouse clicks in the world: spawn and despawn boids
+void HandleSpawning(FlockPool &flock, Vector2 mouse_pos);
+// middle click places an obstacle, X removes the ones under the mouse
+void HandleObstacles(ObstacleSet &obstacles, Vector2 mouse_pos);
+void DrawObstacles(const ObstacleSet &obstacles);
+// G places the goal of the flock at the mouse, or clears it when pressed over it
+void HandleGoal(bool &has_goal, Vector2 &goal, Vector2 mouse_pos);
+void DrawGoal(bool has_goal, Vector2 goal);
+// uploads the heat pixels into texture (remade when the map changes size) and draws it over the world
+void DrawHeatmap(const DensityMap &map, const std::vector<BoidColor> &pixels, Texture2D &texture);
 
 // raygui helpers
 void DrawConfig();
+void DrawStats(const FrameSnapshot &snap, int drawn);
 
 int main(void)
 {
     InitWindow(WIDTH, HEIGHT, "Boids");
     SetTargetFPS(60);
 
-    std::vector<Boid> boids(BOID_COUNT);
+    FlockPool flock(FLOCK_CAPACITY);
+    SpatialGrid grid;
+    long long tick = 0;
+    FrameSnapshot frame;                   // what gets drawn when not pipelined
+    RenderBuffer render;                   // triangles of the boids in view, rebuilt every frame
+    Texture2D heat_texture = {0};          // one texel per cell of the density map, while the heatmap is on
+    std::unique_ptr<SimPipeline> pipeline; // owns the flock while pipelined
+
+    std::vector<Boid> start;
+    SpawnFlock(start, BOID_COUNT);
+    for (const Boid &b : start)
+        flock.Add(b);
+    grid.Reserve(FLOCK_CAPACITY);
+    ObstacleSet obstacles; // as edited here, the simulation gets a copy after every edit
+    obstacles.Load(OBSTACLE_FILE);
+    world_obstacles.Set(obstacles);
+    bool has_goal = false; // as set here, the simulation gets it with every change
+    Vector2 goal = {0, 0};
 
-    // spawn boids only within screen limit
-    for (int i = 0; i < BOID_COUNT; i++)
-    {
-        boids[i].pos = (Vector2) {(float) (rand() % WORLD_WIDTH), (float) (rand() % WORLD_HEIGHT)};
-        boids[i].vel = (Vector2) {((rand() % 100) / 50.0f - 1), ((rand() % 100) / 50.0f - 1)};
-    }
     Camera2D camera = {0};
     camera.target = (Vector2) {(float) WIDTH / 2, (float) HEIGHT / 2};
     camera.offset = (Vector2) {(float) WIDTH / 2, (float) HEIGHT / 2};
@@ -117,7 +87,9 @@ int main(void)
         BeginDrawing();
         ClearBackground(BLACK);
         BeginMode2D(camera);
-        camera.zoom += GetMouseWheelMove() * 0.1f;
+        // the wheel scrolls the settings panel when over it
+        if (GetMousePosition().x < GetScreenWidth() - Settings::currentOffset)
+            camera.zoom += GetMouseWheelMove() * 0.1f;
         if (camera.zoom < 0.1f)
             camera.zoom = 0.1f;
         if (IsKeyDown(KEY_D))
@@ -129,97 +101,158 @@ int main(void)
         if (IsKeyDown(KEY_S))
             camera.target.y += GetFrameTime() * CAMERA_SPEED;
 
-        for (int i = 0; i < BOID_COUNT; i++)
+        if (Settings::pipelined && !pipeline)
+            pipeline.reset(new SimPipeline(flock, grid, tick));
+        else if (!Settings::pipelined && pipeline)
         {
-            Vector2 sep = {0, 0}, ali = {0, 0}, coh = {0, 0};
-            int count = 0;
-
-            for (int j = 0; j < BOID_COUNT; j++)
-            {
-                if (i == j)
-                    continue;
-
-                float d = Vector2Distance(boids[i].pos, boids[j].pos);
-                if (d < Settings::perception_radius && d > 0)
-                {
-                    Vector2 diff = boids[i].pos - boids[j].pos;
-                    sep += (diff * (1.0f) / (d + 0.0001f));
-                    ali += boids[j].vel;
-                    coh += boids[j].pos;
-                    count++;
-                }
-            }
-
-            if (count > 0)
-            {
-                ali = (ali * 1.0f / count);
-                coh = (coh * 1.0f / count) - boids[i].pos;
-            }
+            pipeline->Stop();
+            tick = pipeline->Tick();
+            pipeline.reset();
+        }
 
-            // --- mouse seperation handling ---
-            Vector2 mouse_pos = GetScreenToWorld2D(GetMousePosition(), camera);
-            Vector2 mouse_sep;
-            if (mouse_pos.x > WORLD_WIDTH || mouse_pos.y > WORLD_HEIGHT)
-                mouse_sep = {0, 0};
-            else
-                mouse_sep = boids[i].pos - mouse_pos;
-            float mouse_dis = Vector2Length(mouse_sep);
-            // mouse can only push if within boid detection range
-            if (mouse_dis < Settings::perception_radius && mouse_dis > 0)
-                mouse_sep = Vector2Normalize(mouse_sep) * (1.0f / (mouse_dis + 0.001f));
-            else
-                mouse_sep = {0, 0};
-            // --- ---
-            // --- wall work ---
-            Vector2 wall_sep = {0};
-            if (boids[i].pos.x >= WORLD_WIDTH - WALL_TOL)
-            {
-                wall_sep.x = boids[i].pos.x - WORLD_WIDTH;
-            }
-            if (boids[i].pos.x <= WALL_TOL)
-            {
-                wall_sep.x = boids[i].pos.x;
-            }
-            if (boids[i].pos.y >= WORLD_HEIGHT - WALL_TOL)
-            {
-                wall_sep.y = boids[i].pos.y - WORLD_HEIGHT;
-            }
-            if (boids[i].pos.y <= WALL_TOL)
-            {
-                wall_sep.y = boids[i].pos.y;
-            }
-            float wall_mag = Vector2Length(wall_sep);
-            if (!Settings::WrapAroundWorld)
-            {
-                wall_sep = Vector2Normalize(wall_sep) * (1.0f / (wall_mag + 0.001f));
-            }
-            else
-                wall_sep = {0};
-            float deltaTime = GetFrameTime();
-            boids[i].vel += ali * Settings::ali_weight * deltaTime + coh * Settings::coh_weight * deltaTime +
-                            sep * Settings::sep_weight * deltaTime +
-                            mouse_sep * deltaTime * Settings::mouse_weight * MOUSE_CONST +
-                            wall_sep * deltaTime * Settings::wall_weight * WALL_CONST;
-            boids[i].vel = Vector2ClampValue(boids[i].vel, 0, Settings::max_speed);
-            boids[i].pos = boids[i].pos + boids[i].vel;
-            if (Settings::WrapAroundWorld)
-                boids[i].WrapAroundWorld();
-            else
-                boids[i].ClampToWorld();
-            boids[i].UpdateTriangle();
-            DrawTriangle(boids[i].vertices.v1, boids[i].vertices.v3, boids[i].vertices.v2, RAYWHITE);
+        Vector2 mouse_pos = GetScreenToWorld2D(GetMousePosition(), camera);
+        ViewRect view = {GetScreenToWorld2D({0, 0}, camera),
+                         GetScreenToWorld2D({(float) GetScreenWidth(), (float) GetScreenHeight()}, camera)};
+        HandleSpawning(flock, mouse_pos);
+        HandleObstacles(obstacles, mouse_pos);
+        HandleGoal(has_goal, goal, mouse_pos);
+        const FrameSnapshot *snap = &frame;
+        if (pipeline)
+        {
+            // tick N + 1 runs on the simulation thread while tick N is drawn
+            pipeline->RequestTick(mouse_pos, GetFrameTime(), view);
+            snap = &pipeline->Latest();
+        }
+        else
+        {
+            flock.Apply();
+            StepFlock(flock.boids, grid, mouse_pos, GetFrameTime(), &view, flock.species.data());
+            CaptureSnapshot(flock, ++tick, frame);
+        }
+        // the heatmap goes under everything else
+        render.BuildHeat(snap->heat);
+        DrawHeatmap(snap->heat, render.heat, heat_texture);
+        render.Build(snap->boids, view.min, view.max);
+        for (size_t i = 0; i < render.triangles.size(); i++)
+        {
+            const Triangle &t = render.triangles[i];
+            BoidColor c = render.colors[i];
+            DrawTriangle(t.v1, t.v3, t.v2, (Color) {c.r, c.g, c.b, c.a});
+        }
+        DrawObstacles(obstacles);
+        DrawGoal(has_goal, goal);
+        for (const RenderBoid &p : snap->predators)
+        {
+            Triangle t = BoidTriangle(p.pos, p.vel, 3 * TRI_DIM);
+            DrawTriangle(t.v1, t.v3, t.v2, (Color) {p.color.r, p.color.g, p.color.b, p.color.a});
         }
         DrawRectangleLines(0, 0, WORLD_HEIGHT, WORLD_WIDTH, GREEN);
         EndMode2D();
         DrawConfig();
         DrawFPS(0, 0);
+        DrawStats(*snap, (int) render.triangles.size());
         EndDrawing();
     }
+    pipeline.reset();
 
+    if (heat_texture.id != 0)
+        UnloadTexture(heat_texture);
     CloseWindow();
     return 0;
 }
 
+void HandleSpawning(FlockPool &flock, Vector2 mouse_pos)
+{
+    // clicks on the settings panel are not for the world
+    if (GetMousePosition().x > GetScreenWidth() - Settings::currentOffset - 50)
+        return;
+    if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
+    {
+        // with several species, every burst is the next species in turn
+        static int burst = 0;
+        int kind = Settings::species > 1 ? ++burst % Settings::species : 0;
+        for (int i = 0; i < SPAWN_BURST; i++)
+        {
+            float angle = (float) GetRandomValue(0, 359) * DEG2RAD;
+            float speed = (float) GetRandomValue(10, 100) / 100.0f * Settings::max_speed;
+            flock.Spawn(mouse_pos, {cosf(angle) * speed, sinf(angle) * speed}, kind);
+        }
+    }
+    if (IsMouseButtonPressed(MOUSE_BUTTON_RIGHT))
+        flock.DespawnArea(mouse_pos, DESPAWN_RADIUS);
+}
+
+void HandleObstacles(ObstacleSet &obstacles, Vector2 mouse_pos)
+{
+    if (GetMousePosition().x > GetScreenWidth() - Settings::currentOffset - 50)
+        return;
+    bool edited = false;
+    if (IsMouseButtonPressed(MOUSE_BUTTON_MIDDLE))
+    {
+        obstacles.circles.push_back({mouse_pos, OBSTACLE_RADIUS});
+        edited = true;
+    }
+    if (IsKeyPressed(KEY_X))
+        edited = obstacles.RemoveAt(mouse_pos);
+    // the field is baked again by the next tick
+    if (edited)
+        world_obstacles.Set(obstacles);
+}
+
+void DrawObstacles(const ObstacleSet &obstacles)
+{
+    for (const ObstacleCircle &c : obstacles.circles)
+        DrawCircleLines((int) c.center.x, (int) c.center.y, c.radius, GRAY);
+    for (const ObstaclePolygon &poly : obstacles.polygons)
+        for (size_t i = 0, j = poly.points.size() - 1; i < poly.points.size(); j = i++)
+            DrawLineV(poly.points[j], poly.points[i], GRAY);
+}
+
+void HandleGoal(bool &has_goal, Vector2 &goal, Vector2 mouse_pos)
+{
+    if (!IsKeyPressed(KEY_G) || GetMousePosition().x > GetScreenWidth() - Settings::currentOffset - 50)
+        return;
+    // the path field is searched again over the next ticks
+    if (has_goal && Vector2Distance(mouse_pos, goal) <= GOAL_RADIUS)
+    {
+        has_goal = false;
+        world_goal.ClearGoal();
+    }
+    else
+    {
+        has_goal = true;
+        goal = mouse_pos;
+        world_goal.SetGoal(goal);
+    }
+}
+
+void DrawGoal(bool has_goal, Vector2 goal)
+{
+    if (!has_goal)
+        return;
+    DrawCircleLines((int) goal.x, (int) goal.y, GOAL_RADIUS, GOLD);
+    DrawCircleLines((int) goal.x, (int) goal.y, GOAL_RADIUS / 2, GOLD);
+}
+
+void DrawHeatmap(const DensityMap &map, const std::vector<BoidColor> &pixels, Texture2D &texture)
+{
+    if (map.Empty())
+        return;
+    if (texture.id == 0 || texture.width != map.cols || texture.height != map.rows)
+    {
+        if (texture.id != 0)
+            UnloadTexture(texture);
+        Image image = GenImageColor(map.cols, map.rows, BLANK);
+        texture = LoadTextureFromImage(image);
+        UnloadImage(image);
+        // texel centers sit at the cell centers, so the density is blended smoothly between cells
+        SetTextureFilter(texture, TEXTURE_FILTER_BILINEAR);
+    }
+    UpdateTexture(texture, pixels.data());
+    DrawTexturePro(texture, {0, 0, (float) map.cols, (float) map.rows},
+                   {map.origin_x, map.origin_y, map.cols * map.cell_size, map.rows * map.cell_size}, {0, 0}, 0, WHITE);
+}
+
 void DrawConfig()
 {
     using namespace Settings;
@@ -231,9 +264,12 @@ void DrawConfig()
     {
         Rectangle panel = {(float) WIDTH - menuWidth, 0, menuWidth, (float) HEIGHT};
 
-        GuiPanel(panel, "BOID CONFIGURATOR");
+        Rectangle view;
+        GuiScrollPanel(panel, "BOID CONFIGURATOR", {panel.x, panel.y, panel.width - 14, MENU_HEIGHT}, &menuScroll,
+                       &view);
+        BeginScissorMode((int) view.x, (int) view.y, (int) view.width, (int) view.height);
         float startX = panel.x + 60;
-        float startY = 50;
+        float startY = 50 + menuScroll.y;
         GuiLabel({startX, startY, 120, 20}, "Seperation");
         GuiSliderBar({startX, startY + 20, 120, 20}, "0", "1000", &sep_weight, 0, 1000);
         GuiLabel({startX, startY + 40, 120, 20}, "Alignment");
@@ -248,6 +284,45 @@ void DrawConfig()
             ;
         GuiLabel({startX, startY + 240, 120, 20}, "Wall fear");
         GuiSliderBar({startX, startY + 260, 120, 20}, "0", "100", &wall_weight, 0, 100);
+        GuiLabel({startX, startY + 280, 120, 20}, "Neighbour cap");
+        float cap = (float) max_neighbors;
+        GuiSliderBar({startX, startY + 300, 120, 20}, "0", "100", &cap, 0, 100);
+        max_neighbors = (int) cap;
+        GuiToggle({startX, startY + 340, 120, 20}, "Approximate math", &approx_math);
+        GuiLabel({startX, startY + 370, 120, 20}, "Threading");
+        GuiComboBox({startX, startY + 390, 120, 20}, "Serial;OpenMP;Thread pool;std::execution", &backend);
+        GuiComboBox({startX, startY + 420, 120, 20}, "No pinning;Compact;Scatter", &affinity);
+        GuiToggle({startX, startY + 460, 120, 20}, "Pipelined", &pipelined);
+        GuiToggle({startX, startY + 490, 120, 20}, "Show profiler", &showStats);
+        GuiToggle({startX, startY + 520, 120, 20}, "Incremental grid", &incremental_grid);
+        GuiLabel({startX, startY + 550, 120, 20}, "Steer every N ticks");
+        float groups = (float) steer_groups;
+        GuiSliderBar({startX, startY + 570, 120, 20}, "1", "8", &groups, 1, 8);
+        steer_groups = (int) groups;
+        GuiToggle({startX, startY + 600, 120, 20}, "LOD off screen", &lod);
+        GuiToggle({startX, startY + 630, 120, 20}, "Cell sums", &cell_sums);
+        GuiLabel({startX, startY + 660, 120, 20}, "Long range pull");
+        GuiSliderBar({startX, startY + 680, 120, 20}, "0", "100", &long_range_weight, 0, 100);
+        GuiLabel({startX, startY + 700, 120, 20}, "Quadtree theta");
+        GuiSliderBar({startX, startY + 720, 120, 20}, "0.1", "1.5", &theta, 0.1f, 1.5f);
+        GuiLabel({startX, startY + 750, 120, 20}, "Species");
+        float kinds = (float) species;
+        GuiSliderBar({startX, startY + 770, 120, 20}, "1", "8", &kinds, 1, 8);
+        species = (int) kinds;
+        GuiLabel({startX, startY + 800, 120, 20}, "Predators");
+        float hunters = (float) predator_count;
+        GuiSliderBar({startX, startY + 820, 120, 20}, "0", "500", &hunters, 0, 500);
+        predator_count = (int) hunters;
+        GuiLabel({startX, startY + 850, 120, 20}, "Fear");
+        GuiSliderBar({startX, startY + 870, 120, 20}, "0", "100", &fear_weight, 0, 100);
+        GuiLabel({startX, startY + 900, 120, 20}, "Obstacle weight");
+        GuiSliderBar({startX, startY + 920, 120, 20}, "0", "100", &obstacle_weight, 0, 100);
+        GuiLabel({startX, startY + 950, 120, 20}, "Wind");
+        GuiSliderBar({startX, startY + 970, 120, 20}, "0", "100", &wind_weight, 0, 100);
+        GuiLabel({startX, startY + 1000, 120, 20}, "Goal weight");
+        GuiSliderBar({startX, startY + 1020, 120, 20}, "0", "100", &goal_weight, 0, 100);
+        GuiToggle({startX, startY + 1060, 120, 20}, "Density heatmap", &heatmap);
+        EndScissorMode();
     }
 
     float btnX = (float) GetScreenWidth() - currentOffset - 40;
@@ -256,3 +331,41 @@ void DrawConfig()
         menuActive = !menuActive;
     }
 }
+
+void DrawStats(const FrameSnapshot &snap, int drawn)
+{
+    if (!Settings::showStats)
+        return;
+    DrawText(TextFormat("tick %lld  grid %.2f ms  steer %.2f ms  move %.2f ms", snap.tick, snap.grid_ms, snap.steer_ms,
+                        snap.move_ms),
+             0, 20, 10, GREEN);
+    if (Settings::incremental_grid)
+        DrawText(TextFormat("%d boids changed cell", snap.grid_migrated), 330, 20, 10, GREEN);
+    if (Settings::long_range_weight > 0)
+        DrawText(TextFormat("quadtree %.2f ms", snap.tree_ms), 460, 20, 10, GREEN);
+    if (Settings::predator_count > 0)
+        DrawText(TextFormat("hunt %.2f ms", snap.hunt_ms), 560, 20, 10, GREEN);
+    if (snap.sdf_ms > 0)
+        DrawText(TextFormat("obstacles baked in %.2f ms", snap.sdf_ms), 460, 32, 10, GREEN);
+    if (Settings::wind_weight > 0)
+        DrawText(TextFormat("wind grid %.2f ms", snap.wind_ms), 620, 32, 10, GREEN);
+    if (snap.path_ms > 0)
+        DrawText(TextFormat("path field %.2f ms", snap.path_ms), 720, 32, 10, GREEN);
+    if (!snap.heat.Empty())
+        DrawText(TextFormat("heatmap %.3f ms", snap.heat_ms), 820, 32, 10, GREEN);
+    DrawText(TextFormat("capped %d boids (%lld total, %lld frames)", snap.capped_boids, snap.capped_total,
+                        snap.capped_frames),
+             0, 32, 10, GREEN);
+    if (Settings::steer_groups > 1)
+        DrawText(TextFormat("%d boids steered", snap.steered_boids), 330, 32, 10, GREEN);
+    if (Settings::lod)
+        DrawText(TextFormat("LOD full %d  reduced %d  aggregate %d", snap.lod_boids[LOD_FULL],
+                            snap.lod_boids[LOD_REDUCED], snap.lod_boids[LOD_AGGREGATE]),
+                 330, 44, 10, GREEN);
+    DrawText(TextFormat("boids %d / %d (%d drawn)  scratch %.1f KB (high water %.1f KB)", (int) snap.boids.size(),
+                        FLOCK_CAPACITY, drawn, snap.arena_kb, snap.arena_high_water_kb),
+             0, 44, 10, GREEN);
+    for (int w = 0; w < (int) snap.worker_busy_ms.size(); w++)
+        DrawText(TextFormat("worker %d busy %.2f ms  idle %.2f ms", w, snap.worker_busy_ms[w], snap.worker_idle_ms[w]),
+                 0, 56 + 12 * w, 10, GREEN);
+}
@@ -0,0 +1,122 @@
+/* Headless run of the flock split over processes, see core/strips.h
+ * Runs the same flock once in this process and once cut into vertical strips,
+ * one process per strip, and prints what every strip did, the speedup, and
+ * how far the two runs ended up apart.
+ *
+ * usage : ./boids_strips [boid count] [steps] [processes] [shm|tcp]
+ * built with BOIDS_MPI : mpirun -n [processes] ./boids_strips [boid count] [steps]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "core/strips.h"
+
+#define BENCH_DT (1.0f / 60.0f)
+
+static const char *TRANSPORT_NAMES[] = {"shm", "tcp", "mpi"};
+
+void PrintStrips(const std::vector<StripStats> &stats, int steps)
+{
+    printf("%-6s %8s %11s %9s %9s %9s %11s %9s\n", "strip", "boids", "compute ms", "comm ms", "wait ms",
+           "halo", "migrated", "KB");
+    for (int s = 0; s < (int) stats.size(); s++)
+    {
+        const StripStats &st = stats[s];
+        printf("%-6d %8d %11.3f %9.3f %9.3f %9.1f %11.1f %9.1f\n", s, st.owned, st.compute_ms / steps,
+               st.comm_ms / steps, st.wait_ms / steps, (double) st.halo_sent / steps, (double) st.migrated / steps,
+               st.bytes_sent / 1024.0 / steps);
+    }
+    printf("(per step)\n");
+}
+
+int main(int argc, char **argv)
+{
+#ifdef BOIDS_MPI
+    MPI_Init(&argc, &argv);
+    int rank, processes;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &processes);
+    StripTransport transport = TRANSPORT_MPI;
+#else
+    int rank = 0;
+    int processes = argc > 3 ? atoi(argv[3]) : ThreadCount();
+    StripTransport transport = argc > 4 && strcmp(argv[4], "tcp") == 0 ? TRANSPORT_TCP : TRANSPORT_SHM;
+#endif
+    int count = argc > 1 ? atoi(argv[1]) : 100000;
+    int steps = argc > 2 ? atoi(argv[2]) : 100;
+    if (count < 1 || steps < 1 || processes < 1)
+    {
+        fprintf(stderr, "usage : %s [boid count] [steps] [processes] [shm|tcp]\n", argv[0]);
+        return 1;
+    }
+
+    float scale = sqrtf((float) count / BOID_COUNT);
+    Settings::world_width = WORLD_WIDTH * scale;
+    Settings::world_height = WORLD_HEIGHT * scale;
+    if (!StripsFit(processes))
+    {
+        fprintf(stderr, "%d strips of a %.0f wide world are narrower than perception radius + max speed\n", processes,
+                Settings::world_width);
+        return 1;
+    }
+    // every process spawns the same flock
+    srand(1);
+    std::vector<Boid> start;
+    SpawnFlock(start, count);
+    Settings::backend = BACKEND_SERIAL;
+
+    // --- strips ---
+    std::vector<Boid> split = start;
+    std::vector<StripStats> stats;
+    double t0 = NowMs();
+#ifdef BOIDS_MPI
+    MPI_Barrier(MPI_COMM_WORLD);
+    t0 = NowMs();
+    bool ok = RunStripsMpi(split, steps, BENCH_DT, stats);
+    MPI_Barrier(MPI_COMM_WORLD);
+#else
+    bool ok = RunStrips(split, processes, transport, steps, BENCH_DT, stats);
+#endif
+    double split_ms = NowMs() - t0;
+    if (!ok)
+    {
+        fprintf(stderr, "strip run failed\n");
+        return 1;
+    }
+    if (rank != 0)
+    {
+#ifdef BOIDS_MPI
+        MPI_Finalize();
+#endif
+        return 0;
+    }
+
+    // --- reference: the whole flock in this process, single threaded like every strip ---
+    std::vector<Boid> single = start;
+    SpatialGrid grid;
+    t0 = NowMs();
+    for (int s = 0; s < steps; s++)
+        StepFlock(single, grid, NO_MOUSE, BENCH_DT);
+    double single_ms = NowMs() - t0;
+
+    printf("%d boids, world %.0f x %.0f, %d steps, %d strips over %s\n\n", count, Settings::world_width,
+           Settings::world_height, steps, processes, TRANSPORT_NAMES[transport]);
+    PrintStrips(stats, steps);
+    int owned = 0;
+    for (const StripStats &st : stats)
+        owned += st.owned;
+    double drift = 0.0;
+    for (int i = 0; i < count; i++)
+        drift += Vector2DistanceSqr(single[i].pos, split[i].pos);
+    printf("\nsingle process %.3f ms/step, %d strips %.3f ms/step (with startup), speedup %.2f\n", single_ms / steps,
+           processes, split_ms / steps, single_ms / split_ms);
+    printf("boids after the run %d of %d%s; position rms vs single process %.3f\n", owned, count,
+           owned == count ? "" : "  LOST BOIDS", sqrt(drift / count));
+#ifdef BOIDS_MPI
+    MPI_Finalize();
+#endif
+    return owned == count ? 0 : 1;
+}
@@ -0,0 +1,1245 @@
+/* Headless core of the boids simulation
+ * Holds the boid data, the simulation settings and the flock step, without
+ * touching any raylib window, input or drawing function (only raymath), so
+ * that it can be shared between boids_game.cpp and the headless benchmark.
+ * Everything frame dependent (mouse position, deltaTime) is passed in.
+ */
+
+#ifndef BOIDS_CORE_H
+#define BOIDS_CORE_H
+
+#include <assert.h>
+#include <atomic>
+#include <chrono>
+#include <math.h>
+#include <raymath.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef BOIDS_STD_EXECUTION
+#include <algorithm>
+#include <execution>
+#include <iterator>
+#endif
+
+#include "flow_field.h"
+#include "heatmap.h"
+#include "obstacles.h"
+#include "path_field.h"
+#include "quadtree.h"
+#include "rule_pipeline.h"
+#include "spatial_grid.h"
+#include "thread_pool.h"
+
+#define WORLD_WIDTH 2000
+#define WORLD_HEIGHT 2000
+#define BOID_COUNT 600  // total boids
+#define MOUSE_CONST 100 // a constant to scale mouse_weight
+#define WALL_CONST 100  // a constant to scale wall_weight
+#define WALL_TOL 100.0f // distance at which wall starts exerting force
+#define OBSTACLE_CONST 100   // a constant to scale obstacle_weight
+#define OBSTACLE_TOL 50.0f   // distance at which obstacles start exerting force
+#define SDF_CELL 8.0f        // node spacing of the obstacle distance field
+#define WIND_CONST 1         // a constant to scale wind_weight
+#define GOAL_CONST 1         // a constant to scale goal_weight
+#define LONG_RANGE_CONST 10 // a constant to scale long_range_weight
+#define TRI_DIM 5.0f    // length from center to vertice of boid triangle
+#define SEP_BATCH 64    // neighbours buffered before the approximate separation weights are computed
+#define BOID_CHUNK 4096 // boids per task in the per-boid passes
+#define STEER_CHUNK 256 // boids per task (on average) in the steering pass, which is chunked by cells
+#define SUM_SPLIT 2     // cell sums mode, grid cells are perception radius / SUM_SPLIT wide
+#define LOD_NEAR 500.0f // LOD, boids up to this far out of the view are steered at a reduced rate
+#define LOD_RATE 4      // LOD, steps between two steerings of a boid of the reduced tier
+#define MAX_SPECIES 32  // species ids are below this
+#define FEAR_CONST 100  // a constant to scale fear_weight
+#define HUNT_RADIUS 400.0f   // predators see prey up to this far
+#define PREDATOR_SPEED 1.25f // top speed of the predators, in max_speed
+#define PREDATOR_TURN 3.0f   // share of the gap to the wanted velocity a predator closes per second
+#define PREDATOR_CHUNK 64    // predators per task in the hunt
+
+// how the per-boid passes of a step are spread over threads
+enum Backend
+{
+    BACKEND_SERIAL = 0,
+    BACKEND_OPENMP,  // static schedule, only when built with -fopenmp (serial otherwise)
+    BACKEND_POOL,    // the work-stealing pool of core/thread_pool.h
+    BACKEND_STD_PAR, // std::execution::par_unseq, only when built with -DBOIDS_STD_EXECUTION (serial otherwise)
+};
+
+// backend used unless changed at runtime, e.g. -DBOIDS_DEFAULT_BACKEND=BACKEND_STD_PAR on hosts without libgomp
+#ifndef BOIDS_DEFAULT_BACKEND
+#define BOIDS_DEFAULT_BACKEND BACKEND_POOL
+#endif
+
+// LOD tiers, from the distance of a boid to the camera view
+enum LodTier
+{
+    LOD_FULL = 0,  // in view, or close enough to steer a boid in view: every neighbour, every step
+    LOD_REDUCED,   // up to LOD_NEAR out of view: every neighbour, every LOD_RATE steps
+    LOD_AGGREGATE, // further: every LOD_RATE steps, from the sums of the nearby cells instead of the neighbours
+    LOD_TIERS,
+};
+
+// namespace to hold all simulation config
+namespace Settings
+{
+// --- BOID CONTROL ---
+inline float perception_radius = 50.0f;
+inline float max_speed = 2.5f;
+inline float sep_weight = 100.0f;
+inline float ali_weight = 50.0f;
+inline float coh_weight = 40.0f;
+inline float mouse_weight = 50.0f;
+inline float wall_weight = 50.0f;
+inline float obstacle_weight = 50.0f;
+inline float wind_weight = 0.0f; // push of the wind, 0 turns it off
+inline float goal_weight = 50.0f; // pull along the way to the goal, once one is set in world_goal
+inline float long_range_weight = 0.0f; // pull toward the far flock, 0 turns the quadtree off
+inline float theta = 0.5f;             // quadtree opening angle, bigger is faster and coarser
+inline bool WrapAroundWorld = false;
+inline int max_neighbors = 0;         // neighbour budget per boid, 0 means unlimited
+inline bool approx_math = false;      // separation weights from an rsqrt approximation instead of sqrt + divide
+inline bool incremental_grid = false; // keep the grid cells from step to step, moving only the boids that changed cell
+inline int steer_groups = 1;          // steering of a boid recomputed every steer_groups steps, its last one reused between
+inline bool lod = false;              // steer the boids away from the camera view with less care, see LodTier
+inline bool cell_sums = false;        // alignment and cohesion from per-cell sums for the cells fully in range
+inline bool heatmap = false;          // keep flock_density, the smoothed density of the flock, up to date
+inline int species = 1;               // species with their own pair weights (species_matrix), 1 ignores species
+inline int predator_count = 0;        // predators hunting the flock
+inline float fear_weight = 50.0f;     // push of a predator on the boids within fear_radius of it
+inline float fear_radius = 100.0f;
+// --- ---
+// --- Threading ---
+inline int backend = BOIDS_DEFAULT_BACKEND;
+inline int threads = 0; // 0 means one per hardware thread
+inline int affinity = AFFINITY_NONE;
+// --- ---
+// --- World ---
+inline float world_width = WORLD_WIDTH;
+inline float world_height = WORLD_HEIGHT;
+// --- ---
+}; // namespace Settings
+
+// namespace to hold profiling counters, refreshed every step
+namespace Stats
+{
+inline double grid_ms = 0.0;        // time spent rebuilding the spatial grid
+inline double heat_ms = 0.0;        // time spent updating the density map from the grid counts
+inline int grid_migrated = 0;       // incremental grid only, boids that changed cell this step
+inline double tree_ms = 0.0;        // time spent building the long-range quadtree
+inline double hunt_ms = 0.0;        // time spent moving the predators and building their grid
+inline double sdf_ms = 0.0;         // time the last bake of the obstacle distance field took
+inline double wind_ms = 0.0;        // time the latest wind grid took to generate, on its own thread
+inline double path_ms = 0.0;        // time spent on the search of the path field to the goal
+inline double steer_ms = 0.0;       // time spent gathering neighbours and computing forces
+inline double move_ms = 0.0;        // time spent integrating
+inline int steered_boids = 0;       // boids whose steering was recomputed this step
+inline int lod_boids[LOD_TIERS];    // boids per LOD tier this step, all of them in LOD_FULL unless LOD is on
+inline long long steps = 0;         // steps since the start, picks the steering group of a step
+inline int capped_boids = 0;        // boids that hit the neighbour budget this step
+inline long long capped_total = 0;  // same, summed over the whole run
+inline long long capped_frames = 0; // steps in which the budget triggered at least once
+inline std::vector<double> worker_busy_ms; // thread pool only, per worker time spent running tasks this step
+inline std::vector<double> worker_idle_ms; // thread pool only, per worker time spent waiting for tasks this step
+inline double arena_kb = 0.0;              // frame arena used by this step
+inline double arena_high_water_kb = 0.0;   // most frame arena any step used
+inline long long heap_allocations = -1;    // operator new calls of this step, -1 unless built with BOIDS_COUNT_ALLOCATIONS
+}; // namespace Stats
+
+// Only the state the physics reads and writes every step, per-boid data the steps don't need
+// (species, color, energy, id) is kept apart by the owner of the flock, see core/flock_pool.h
+class Boid
+{
+  public:
+    Vector2 pos;
+    Vector2 vel;
+    Vector2 acc; // steering force of this step, before deltaTime scaling
+    Boid() {};
+    void WrapAroundWorld(float width, float height)
+    {
+        if (pos.x > width)
+            pos.x -= width;
+        if (pos.y > height)
+            pos.y -= height;
+        if (pos.x < 0)
+            pos.x += width;
+        if (pos.y < 0)
+            pos.y += height;
+    }
+    void ClampToWorld(float width, float height)
+    {
+        if (pos.x > width)
+            pos.x = width;
+        else if (pos.x < 0)
+            pos.x = 0;
+        if (pos.y > height)
+            pos.y = height;
+        if (pos.y < 0)
+            pos.y = 0;
+    }
+};
+
+// mouse far outside the world, so it never pushes anyone
+inline const Vector2 NO_MOUSE = {-1e9f, -1e9f};
+
+// part of the world the camera shows, in world coordinates
+struct ViewRect
+{
+    Vector2 min;
+    Vector2 max;
+};
+
+// Everything a step reads of Settings, the weights already scaled by their constants, plus the frame inputs.
+// Made once per step by MakeTickParams(), so the per-boid work reads no global, and a step sees the same
+// settings from start to end, whatever the GUI changes meanwhile.
+struct TickParams
+{
+    Vector2 mouse_pos; // world space, NO_MOUSE for none
+    float dt;
+    float radius;  // perception radius
+    float radius2; // and its square
+    float max_speed;
+    float world_width, world_height;
+    bool wrap;
+    float sep_weight, ali_weight, coh_weight;
+    float mouse_push;      // mouse_weight * MOUSE_CONST
+    float wall_push;       // wall_weight * WALL_CONST
+    float obstacle_push;   // obstacle_weight * OBSTACLE_CONST
+    const DistanceField *obstacles; // baked obstacles, set by StepFlock() at any weight, none when the world has none
+    float wind_push;       // wind_weight * WIND_CONST
+    const FlowGrid *wind;  // latest wind grid, set by StepFlock() while wind_push is not 0
+    float goal_push;       // goal_weight * GOAL_CONST
+    const FlowGrid *goal;  // way to the goal, set by StepFlock() while there is one and goal_push is not 0
+    float long_range_push; // long_range_weight * LONG_RANGE_CONST, 0 turns the quadtree off
+    float theta;
+    float fear_push; // fear_weight * FEAR_CONST
+    float fear_radius;
+    int max_neighbors;
+    bool approx_math;
+    bool incremental_grid;
+    bool cell_sums; // off while species > 1, the sums of a cell don't know the species of its boids
+    bool heatmap;
+    bool lod;
+    int groups; // steer_groups, at least 1
+    int species;
+    int predator_count;
+    int backend;  // BACKEND_*, the step runs on
+    int threads;  // of the backend, 0 for every hardware thread
+    int affinity; // AFFINITY_* of the pool threads
+};
+
+inline TickParams MakeTickParams(Vector2 mouse_pos, float deltaTime)
+{
+    TickParams p;
+    p.mouse_pos = mouse_pos;
+    p.dt = deltaTime;
+    p.radius = Settings::perception_radius;
+    p.radius2 = p.radius * p.radius;
+    p.max_speed = Settings::max_speed;
+    p.world_width = Settings::world_width;
+    p.world_height = Settings::world_height;
+    p.wrap = Settings::WrapAroundWorld;
+    p.sep_weight = Settings::sep_weight;
+    p.ali_weight = Settings::ali_weight;
+    p.coh_weight = Settings::coh_weight;
+    p.mouse_push = Settings::mouse_weight * MOUSE_CONST;
+    p.wall_push = Settings::wall_weight * WALL_CONST;
+    p.obstacle_push = Settings::obstacle_weight * OBSTACLE_CONST;
+    p.obstacles = nullptr;
+    p.wind_push = Settings::wind_weight * WIND_CONST;
+    p.wind = nullptr;
+    p.goal_push = Settings::goal_weight * GOAL_CONST;
+    p.goal = nullptr;
+    p.long_range_push = Settings::long_range_weight > 0 ? Settings::long_range_weight * LONG_RANGE_CONST : 0.0f;
+    p.theta = Settings::theta;
+    p.fear_push = Settings::fear_weight * FEAR_CONST;
+    p.fear_radius = Settings::fear_radius;
+    p.max_neighbors = Settings::max_neighbors;
+    p.approx_math = Settings::approx_math;
+    p.incremental_grid = Settings::incremental_grid;
+    p.cell_sums = Settings::cell_sums && Settings::species <= 1;
+    p.heatmap = Settings::heatmap;
+    p.lod = Settings::lod;
+    p.groups = Settings::steer_groups > 1 ? Settings::steer_groups : 1;
+    p.species = Settings::species;
+    p.predator_count = Settings::predator_count > 0 ? Settings::predator_count : 0;
+    p.backend = Settings::backend;
+    p.threads = Settings::threads;
+    p.affinity = Settings::affinity;
+    return p;
+}
+
+inline int BoidLodTier(Vector2 pos, const ViewRect &view, float radius)
+{
+    float dx = fmaxf(0.0f, fmaxf(view.min.x - pos.x, pos.x - view.max.x));
+    float dy = fmaxf(0.0f, fmaxf(view.min.y - pos.y, pos.y - view.max.y));
+    float d2 = dx * dx + dy * dy;
+    if (d2 <= radius * radius)
+        return LOD_FULL;
+    return d2 <= LOD_NEAR * LOD_NEAR ? LOD_REDUCED : LOD_AGGREGATE;
+}
+
+inline double NowMs()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// threads to run on, for a threads setting (0 for every hardware thread)
+inline int ThreadCount(int threads)
+{
+    if (threads > 0)
+        return threads;
+    int n = (int) std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+inline int ThreadCount() { return ThreadCount(Settings::threads); }
+
+// the pool shared by all steps, recreated when the thread settings change
+inline std::unique_ptr<ThreadPool> sim_pool;
+inline ThreadPool &SimPool(int threads, int affinity)
+{
+    if (!sim_pool || sim_pool->Size() != ThreadCount(threads) || sim_pool->Affinity() != affinity)
+        sim_pool.reset(new ThreadPool(ThreadCount(threads), affinity));
+    return *sim_pool;
+}
+inline ThreadPool &SimPool() { return SimPool(Settings::threads, Settings::affinity); }
+
+#ifdef BOIDS_STD_EXECUTION
+// random access iterator over the integers, to run the standard parallel algorithms over an index range
+class IndexIterator
+{
+  public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef int value_type;
+    typedef int difference_type;
+    typedef const int *pointer;
+    typedef int reference;
+
+    IndexIterator(int i = 0) : i(i) {}
+    int operator*() const { return i; }
+    int operator[](int n) const { return i + n; }
+    IndexIterator &operator++() { i++; return *this; }
+    IndexIterator operator++(int) { return IndexIterator(i++); }
+    IndexIterator &operator--() { i--; return *this; }
+    IndexIterator operator--(int) { return IndexIterator(i--); }
+    IndexIterator &operator+=(int n) { i += n; return *this; }
+    IndexIterator &operator-=(int n) { i -= n; return *this; }
+    IndexIterator operator+(int n) const { return IndexIterator(i + n); }
+    friend IndexIterator operator+(int n, IndexIterator it) { return IndexIterator(it.i + n); }
+    IndexIterator operator-(int n) const { return IndexIterator(i - n); }
+    int operator-(IndexIterator other) const { return i - other.i; }
+    bool operator==(IndexIterator other) const { return i == other.i; }
+    bool operator!=(IndexIterator other) const { return i != other.i; }
+    bool operator<(IndexIterator other) const { return i < other.i; }
+    bool operator>(IndexIterator other) const { return i > other.i; }
+    bool operator<=(IndexIterator other) const { return i <= other.i; }
+    bool operator>=(IndexIterator other) const { return i >= other.i; }
+
+  private:
+    int i;
+};
+#endif
+
+// Calls fn(chunk_begin, chunk_end, worker) over [begin, end) in chunks of grain, on the backend of p.
+// fn must not block or use atomics stronger than relaxed, as chunks may be interleaved on one thread
+// (std::execution::par_unseq), where worker is always 0.
+template <typename Fn> void ParallelFor(const TickParams &p, int begin, int end, int grain, Fn &&fn)
+{
+    switch (p.backend)
+    {
+#ifdef BOIDS_STD_EXECUTION
+    case BACKEND_STD_PAR:
+    {
+        int chunks = (end - begin + grain - 1) / grain;
+        std::for_each(std::execution::par_unseq, IndexIterator(0), IndexIterator(chunks), [&](int c) {
+            int b = begin + c * grain;
+            fn(b, b + grain < end ? b + grain : end, 0);
+        });
+        break;
+    }
+#endif
+#ifdef _OPENMP
+    case BACKEND_OPENMP:
+    {
+        int chunks = (end - begin + grain - 1) / grain;
+#pragma omp parallel for schedule(static) num_threads(ThreadCount(p.threads))
+        for (int c = 0; c < chunks; c++)
+        {
+            int b = begin + c * grain;
+            fn(b, b + grain < end ? b + grain : end, omp_get_thread_num());
+        }
+        break;
+    }
+#endif
+    case BACKEND_POOL:
+        SimPool(p.threads, p.affinity).ParallelFor(begin, end, grain, fn);
+        break;
+    default:
+        if (begin < end)
+            fn(begin, end, 0);
+        break;
+    }
+}
+
+// the same, on the current backend, for work outside of a step
+template <typename Fn> void ParallelFor(int begin, int end, int grain, Fn &&fn)
+{
+    ParallelFor(MakeTickParams(NO_MOUSE, 0.0f), begin, end, grain, fn);
+}
+
+// spawn boids anywhere in the world, with a small random velocity
+inline void SpawnFlock(std::vector<Boid> &boids, int count)
+{
+    boids.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        boids[i].pos = (Vector2) {(float) (rand() % (int) Settings::world_width),
+                                  (float) (rand() % (int) Settings::world_height)};
+        boids[i].vel = (Vector2) {((rand() % 100) / 50.0f - 1), ((rand() % 100) / 50.0f - 1)};
+        boids[i].acc = (Vector2) {0, 0};
+    }
+}
+
+// 1/sqrt(x) from a bit-level first guess and one Newton-Raphson step, about 0.2% relative error
+inline float ApproxRsqrt(float x)
+{
+    uint32_t i;
+    float y;
+    memcpy(&i, &x, sizeof(i));
+    i = 0x5f375a86 - (i >> 1);
+    memcpy(&y, &i, sizeof(y));
+    return y * (1.5f - 0.5f * x * y * y);
+}
+
+// Sum of diff / |diff| over a batch of neighbours. The weights are computed in
+// their own loop, with no reduction in it, so the compiler can vectorize it.
+inline Vector2 ApproxSeparation(const float *dx, const float *dy, const float *d2, int n)
+{
+    float w[SEP_BATCH];
+    for (int k = 0; k < n; k++)
+        w[k] = ApproxRsqrt(fmaxf(d2[k], 1e-8f)); // the floor plays the role of the + 0.0001f of the exact path
+    Vector2 sep = {0, 0};
+    for (int k = 0; k < n; k++)
+    {
+        sep.x += dx[k] * w[k];
+        sep.y += dy[k] * w[k];
+    }
+    return sep;
+}
+
+// --- step kernels ---
+// The per-boid work of a step is compiled once per world mode, a kernel, and the kernel of the current settings
+// is picked once per step (DispatchKernel()), so the mouse, wall and boundary tests are not paid per boid.
+struct WrapBoundary
+{
+    static const bool wrap = true;
+    static void Apply(Boid &b, const TickParams &p) { b.WrapAroundWorld(p.world_width, p.world_height); }
+};
+struct ClampBoundary
+{
+    static const bool wrap = false;
+    static void Apply(Boid &b, const TickParams &p) { b.ClampToWorld(p.world_width, p.world_height); }
+};
+
+template <typename Boundary, bool Mouse, bool Walls, bool Fields> struct StepKernel
+{
+    typedef Boundary boundary;
+    static const bool mouse = Mouse;                    // the mouse can push some boid
+    static const bool walls = Walls && !Boundary::wrap; // walls never push in a wrapping world
+    static const bool fields = Fields;                  // some field pushes: obstacles, wind or goal (see FieldsOn())
+};
+
+// Whether the obstacles, the wind or the goal push anyone this step. They share one kernel flag, so that each field
+// does not double the kernels to compile; which of them is on is then a test per boid, always taken the same way.
+inline bool ObstaclesOn(const TickParams &p) { return p.obstacles && p.obstacle_push != 0; }
+inline bool FieldsOn(const TickParams &p) { return ObstaclesOn(p) || p.wind || p.goal; }
+
+// Calls fn with the kernel of the given world mode, with or without fields
+template <typename Boundary, bool Mouse, bool Walls, typename Fn> void DispatchFields(const TickParams &p, Fn &&fn)
+{
+    if (FieldsOn(p))
+        fn(StepKernel<Boundary, Mouse, Walls, true>());
+    else
+        fn(StepKernel<Boundary, Mouse, Walls, false>());
+}
+
+// Calls fn(kernel) with the kernel of the settings and mouse position of the tick
+template <typename Fn> void DispatchKernel(const TickParams &p, Fn &&fn)
+{
+    // boids stay inside the world, a mouse further than perception radius out of it can't reach any
+    // (but past the right or bottom edge it never pushes at all)
+    Vector2 mouse_pos = p.mouse_pos;
+    bool mouse = p.mouse_push != 0 && mouse_pos.x <= p.world_width && mouse_pos.y <= p.world_height &&
+                 mouse_pos.x > -p.radius && mouse_pos.y > -p.radius;
+    bool walls = p.wall_push != 0;
+    if (p.wrap)
+    {
+        if (mouse)
+            DispatchFields<WrapBoundary, true, false>(p, fn);
+        else
+            DispatchFields<WrapBoundary, false, false>(p, fn);
+    }
+    else if (mouse && walls)
+        DispatchFields<ClampBoundary, true, true>(p, fn);
+    else if (mouse)
+        DispatchFields<ClampBoundary, true, false>(p, fn);
+    else if (walls)
+        DispatchFields<ClampBoundary, false, true>(p, fn);
+    else
+        DispatchFields<ClampBoundary, false, false>(p, fn);
+}
+
+// weighted push of the mouse, the walls, the obstacles, the wind and the goal on a boid at pos
+template <typename Kernel> inline Vector2 EnvironmentForce(Vector2 pos, const TickParams &p)
+{
+    Vector2 force = {0, 0};
+    // --- mouse seperation handling ---
+    if (Kernel::mouse)
+    {
+        Vector2 mouse_sep = pos - p.mouse_pos;
+        float mouse_dis = Vector2Length(mouse_sep);
+        // mouse can only push if within boid detection range
+        if (mouse_dis < p.radius && mouse_dis > 0)
+            force += Vector2Normalize(mouse_sep) * (1.0f / (mouse_dis + 0.001f)) * p.mouse_push;
+    }
+    // --- ---
+    // --- wall work ---
+    if (Kernel::walls)
+    {
+        Vector2 wall_sep = {0};
+        if (pos.x >= p.world_width - WALL_TOL)
+        {
+            wall_sep.x = pos.x - p.world_width;
+        }
+        if (pos.x <= WALL_TOL)
+        {
+            wall_sep.x = pos.x;
+        }
+        if (pos.y >= p.world_height - WALL_TOL)
+        {
+            wall_sep.y = pos.y - p.world_height;
+        }
+        if (pos.y <= WALL_TOL)
+        {
+            wall_sep.y = pos.y;
+        }
+        float wall_mag = Vector2Length(wall_sep);
+        force += Vector2Normalize(wall_sep) * (1.0f / (wall_mag + 0.001f)) * p.wall_push;
+    }
+    // --- ---
+    if (!Kernel::fields)
+        return force;
+    // --- obstacles, one lookup whatever their number ---
+    if (ObstaclesOn(p))
+    {
+        DistanceSample sample = p.obstacles->Lookup(pos);
+        // inside an obstacle, pushed out as hard as from one unit away
+        if (sample.dist < OBSTACLE_TOL)
+            force += Vector2Normalize(sample.grad) * (1.0f / fmaxf(sample.dist, 1.0f)) * p.obstacle_push;
+    }
+    // --- ---
+    // --- wind, read from the latest grid ---
+    if (p.wind)
+        force += p.wind->Lookup(pos) * p.wind_push;
+    // --- ---
+    // --- goal, along the shared path field ---
+    if (p.goal)
+        force += p.goal->Lookup(pos) * p.goal_push;
+    // --- ---
+    return force;
+}
+
+// --- steering rules, see core/rule_pipeline.h ---
+struct Alignment
+{
+    Vector2 ali = {0, 0};
+    float weight;
+
+    static constexpr bool sums = true;
+
+    explicit Alignment(const TickParams &p) : weight(p.ali_weight) {}
+    void Gather(const Boid &other, int, Vector2, float) { ali += other.vel; }
+    void GatherCell(int, Vector2, Vector2 sum_vel) { ali += sum_vel; }
+    Vector2 Force(const Boid &, int count)
+    {
+        if (count > 0)
+            ali = (ali * 1.0f / count);
+        return ali * weight;
+    }
+};
+
+struct Cohesion
+{
+    Vector2 coh = {0, 0};
+    float weight;
+
+    static constexpr bool sums = true;
+
+    explicit Cohesion(const TickParams &p) : weight(p.coh_weight) {}
+    void Gather(const Boid &other, int, Vector2, float) { coh += other.pos; }
+    void GatherCell(int, Vector2 sum_pos, Vector2) { coh += sum_pos; }
+    Vector2 Force(const Boid &self, int count)
+    {
+        if (count > 0)
+            coh = (coh * 1.0f / count) - self.pos;
+        return coh * weight;
+    }
+};
+
+struct Separation
+{
+    Vector2 sep = {0, 0};
+    // neighbours waiting for their approximate separation weight
+    float batch_dx[SEP_BATCH], batch_dy[SEP_BATCH], batch_d2[SEP_BATCH];
+    int batched = 0;
+    float weight;
+    bool approx;
+
+    static constexpr bool sums = false; // the push of a neighbour depends on its own distance
+
+    explicit Separation(const TickParams &p) : weight(p.sep_weight), approx(p.approx_math) {}
+    void Gather(const Boid &, int, Vector2 diff, float d2)
+    {
+        if (approx)
+        {
+            batch_dx[batched] = diff.x;
+            batch_dy[batched] = diff.y;
+            batch_d2[batched] = d2;
+            if (++batched == SEP_BATCH)
+            {
+                sep += ApproxSeparation(batch_dx, batch_dy, batch_d2, batched);
+                batched = 0;
+            }
+        }
+        else
+            sep += (diff * (1.0f) / (sqrtf(d2) + 0.0001f));
+    }
+    // as if all count boids stood at the center of mass
+    void GatherMass(int count, Vector2 diff, float d2)
+    {
+        if (d2 > 0)
+            sep += diff * (count / (sqrtf(d2) + 0.0001f));
+    }
+    Vector2 Force(const Boid &, int)
+    {
+        if (batched > 0)
+            sep += ApproxSeparation(batch_dx, batch_dy, batch_d2, batched);
+        return sep * weight;
+    }
+};
+
+// the rules every boid follows, gathered in one pass over its neighbours
+typedef RulePipeline<Alignment, Cohesion, Separation> FlockRules;
+
+// Weights of separation, alignment and cohesion between every pair of species, as multipliers of the weights
+// of the settings. Species ids at or above the species count wrap around, so any id below MAX_SPECIES is valid.
+class SpeciesMatrix
+{
+  public:
+    struct Pair
+    {
+        float sep, ali, coh, unused; // 16 bytes, one load per neighbour
+    };
+
+    SpeciesMatrix() { Reset(1); }
+
+    // same species flock together, other species only keep their distance
+    void Reset(int species)
+    {
+        count = species;
+        for (int a = 0; a < MAX_SPECIES; a++)
+            for (int b = 0; b < MAX_SPECIES; b++)
+                pairs[a][b] = a % species == b % species ? (Pair) {1, 1, 1, 0} : (Pair) {1, 0, 0, 0};
+    }
+    void Set(int a, int b, float sep, float ali, float coh)
+    {
+        for (int x = a; x < MAX_SPECIES; x += count)
+            for (int y = b; y < MAX_SPECIES; y += count)
+                pairs[x][y] = {sep, ali, coh, 0};
+    }
+    int Count() const { return count; }
+    const Pair *Row(int species) const
+    {
+        assert(species >= 0 && species < MAX_SPECIES);
+        return pairs[species];
+    }
+
+  private:
+    int count;
+    Pair pairs[MAX_SPECIES][MAX_SPECIES];
+};
+
+// the pair weights used while Settings::species > 1
+inline SpeciesMatrix species_matrix;
+
+// Separation, alignment and cohesion in a single rule, each neighbour weighted by the pair weights of its species
+// and the species of the boid. Alignment and cohesion are weighted averages of the velocities and offsets, so the
+// neighbours a species ignores (weight 0) don't dilute those it flocks with.
+struct SpeciesFlocking
+{
+    const uint8_t *species;               // of every boid
+    const SpeciesMatrix::Pair *row;       // weights of the steered boid's species against every species
+    Vector2 sep = {0, 0}, ali = {0, 0}, coh = {0, 0};
+    float ali_total = 0, coh_total = 0;   // of the weights, by magnitude so that negative weights don't cancel out
+    float sep_weight, ali_weight, coh_weight;
+    bool approx;
+
+    SpeciesFlocking(const TickParams &p, const uint8_t *species, int self)
+        : species(species), row(species_matrix.Row(species[self])), sep_weight(p.sep_weight),
+          ali_weight(p.ali_weight), coh_weight(p.coh_weight), approx(p.approx_math)
+    {
+    }
+    void Gather(const Boid &other, int j, Vector2 diff, float d2)
+    {
+        SpeciesMatrix::Pair w = row[species[j]];
+        float inv = approx ? ApproxRsqrt(fmaxf(d2, 1e-8f)) : 1.0f / (sqrtf(d2) + 0.0001f);
+        sep += diff * (w.sep * inv);
+        ali += other.vel * w.ali;
+        coh -= diff * w.coh; // other.pos - self.pos
+        ali_total += fabsf(w.ali);
+        coh_total += fabsf(w.coh);
+    }
+    Vector2 Force(const Boid &, int)
+    {
+        if (ali_total > 0)
+            ali = ali * (1.0f / ali_total);
+        if (coh_total > 0)
+            coh = coh * (1.0f / coh_total);
+        return ali * ali_weight + coh * coh_weight + sep * sep_weight;
+    }
+};
+typedef RulePipeline<SpeciesFlocking> SpeciesRules;
+
+// Steering force on boid i, from the neighbours found in the grid, the mouse and the walls.
+// Sets *capped when the neighbour budget stopped the gather early.
+// Compiled once per kernel, grid mode (Linked) and rule set, so that walking a cell stays a plain loop.
+template <typename Kernel, bool Linked, typename Rules>
+inline Vector2 SteerBoidIn(const std::vector<Boid> &boids, const SpatialGrid &grid, int i, const TickParams &p,
+                           bool *capped, Rules rules)
+{
+    int count = 0;
+    float r2 = p.radius2;
+    *capped = false;
+
+    // visit cells nearest-first, so the budget keeps the closest neighbours
+    int cells[9];
+    int cell_count = grid.NearbyCells(boids[i].pos, p.radius, cells);
+    for (int c = 0; c < cell_count && !*capped; c++)
+    {
+        int end = grid.CellEnd<Linked>(cells[c]);
+        for (int k = grid.CellBegin<Linked>(cells[c]); k != end; k = grid.CellNext<Linked>(k))
+        {
+            int j = grid.CellAgent<Linked>(k);
+            if (i == j)
+                continue;
+
+            // reject on squared distance, the sqrt is only paid for boids in range
+            Vector2 diff = boids[i].pos - boids[j].pos;
+            float d2 = diff.x * diff.x + diff.y * diff.y;
+            if (d2 >= r2 || d2 == 0)
+                continue;
+            rules.Gather(boids[j], j, diff, d2);
+            count++;
+            if (p.max_neighbors > 0 && count >= p.max_neighbors)
+            {
+                *capped = true;
+                break;
+            }
+        }
+    }
+
+    return rules.Force(boids[i], count) + EnvironmentForce<Kernel>(boids[i].pos, p);
+}
+
+template <typename Kernel, typename Rules>
+inline Vector2 SteerBoid(const std::vector<Boid> &boids, const SpatialGrid &grid, int i, const TickParams &p,
+                         bool *capped, Rules rules)
+{
+    if (grid.linked)
+        return SteerBoidIn<Kernel, true>(boids, grid, i, p, capped, rules);
+    return SteerBoidIn<Kernel, false>(boids, grid, i, p, capped, rules);
+}
+
+// Steering force of the boids of list into Boid::acc, the kernel picked once for all of them
+inline void SteerBoids(std::vector<Boid> &boids, const SpatialGrid &grid, const int *list, int count,
+                       const TickParams &p)
+{
+    DispatchKernel(p, [&](auto kernel) {
+        bool capped;
+        for (int k = 0; k < count; k++)
+            boids[list[k]].acc = SteerBoid<decltype(kernel)>(boids, grid, list[k], p, &capped, FlockRules(p));
+    });
+}
+
+// boid count, and sums of positions and velocities, of one grid cell
+struct CellSum
+{
+    int count;
+    Vector2 pos;
+    Vector2 vel;
+};
+
+// sums of every cell of the grid, valid until the frame arena is reset
+inline CellSum *SumCells(const std::vector<Boid> &boids, const SpatialGrid &grid, const TickParams &p)
+{
+    int cells = grid.cols * grid.rows;
+    CellSum *sums = frame_arena.Alloc<CellSum>(cells);
+    int grain = (int) ((long long) cells * BOID_CHUNK / (boids.empty() ? 1 : boids.size()));
+    ParallelFor(p, 0, cells, grain > 0 ? grain : 1, [&](int c0, int c1, int) {
+        for (int c = c0; c < c1; c++)
+        {
+            CellSum sum = {0, {0, 0}, {0, 0}};
+            grid.ForEachInCell(c, [&](int i) {
+                sum.count++;
+                sum.pos += boids[i].pos;
+                sum.vel += boids[i].vel;
+                return true;
+            });
+            sums[c] = sum;
+        }
+    });
+    return sums;
+}
+
+// Steering force on boid i from the sums of the cells around it instead of its neighbours: the rules exact
+// from sums (alignment, cohesion) take those of every cell, the others (separation) its center of mass, as if
+// all its boids stood there.
+template <typename Kernel>
+inline Vector2 SteerBoidAggregate(const std::vector<Boid> &boids, const SpatialGrid &grid, const CellSum *sums, int i,
+                                  const TickParams &p)
+{
+    FlockRules rules(p);
+    int count = 0;
+    int own = grid.CellOf(boids[i].pos);
+    grid.ForEachCellInRadius(boids[i].pos, p.radius, [&](int c, bool) {
+        CellSum sum = sums[c];
+        if (c == own)
+        {
+            // without the boid itself
+            sum.count--;
+            sum.pos -= boids[i].pos;
+            sum.vel -= boids[i].vel;
+        }
+        if (sum.count <= 0)
+            return;
+        Vector2 diff = boids[i].pos - sum.pos * (1.0f / sum.count);
+        rules.GatherMass(sum.count, sum.pos, sum.vel, diff, diff.x * diff.x + diff.y * diff.y);
+        count += sum.count;
+    });
+
+    return rules.Force(boids[i], count) + EnvironmentForce<Kernel>(boids[i].pos, p);
+}
+
+// Steering force on boid i like SteerBoid(), for a grid of cells smaller than the perception radius (cell
+// sums mode): the cells lying fully in range give their sums to the rules exact from sums (alignment,
+// cohesion), only the cells across the edge of the range are gathered boid by boid for them. The other rules
+// (separation) stay exact, from every boid in range. The neighbour cap doesn't apply.
+template <typename Kernel, bool Linked>
+inline Vector2 SteerBoidSumsIn(const std::vector<Boid> &boids, const SpatialGrid &grid, const CellSum *sums, int i,
+                               const TickParams &p)
+{
+    FlockRules rules(p);
+    int count = 0;
+    Vector2 pos = boids[i].pos;
+    float r2 = p.radius2;
+    int own = grid.CellOf(pos);
+    bool own_full = false;
+
+    grid.ForEachCellInRadius(pos, p.radius, [&](int c, bool full) {
+        if (full)
+        {
+            rules.GatherCell(sums[c].count, sums[c].pos, sums[c].vel);
+            count += sums[c].count;
+            own_full = own_full || c == own;
+        }
+        int end = grid.CellEnd<Linked>(c);
+        for (int k = grid.CellBegin<Linked>(c); k != end; k = grid.CellNext<Linked>(k))
+        {
+            int j = grid.CellAgent<Linked>(k);
+            if (i == j)
+                continue;
+            Vector2 diff = pos - boids[j].pos;
+            float d2 = diff.x * diff.x + diff.y * diff.y;
+            // every boid of a full cell is in range
+            if ((!full && d2 >= r2) || d2 == 0)
+                continue;
+            if (full)
+                rules.GatherUnsummed(boids[j], j, diff, d2);
+            else
+            {
+                rules.Gather(boids[j], j, diff, d2);
+                count++;
+            }
+        }
+    });
+    // the sums of its own cell hold the boid itself
+    if (own_full)
+    {
+        rules.GatherCell(-1, Vector2Negate(pos), Vector2Negate(boids[i].vel));
+        count--;
+    }
+
+    return rules.Force(boids[i], count) + EnvironmentForce<Kernel>(pos, p);
+}
+
+template <typename Kernel>
+inline Vector2 SteerBoidSums(const std::vector<Boid> &boids, const SpatialGrid &grid, const CellSum *sums, int i,
+                             const TickParams &p)
+{
+    if (grid.linked)
+        return SteerBoidSumsIn<Kernel, true>(boids, grid, sums, i, p);
+    return SteerBoidSumsIn<Kernel, false>(boids, grid, sums, i, p);
+}
+
+// the quadtree of the long-range term, rebuilt every step while the term is on
+inline Quadtree flock_tree;
+// the smoothed density of the flock, by grid cell, updated every step while the heatmap is on (empty otherwise)
+inline DensityMap flock_density;
+
+// the obstacles of the world, set with world_obstacles.Set() from any thread, baked by the next step
+inline ObstacleField world_obstacles;
+// the wind over the world, generated on its own thread while some step asks for it
+inline FlowField world_wind;
+// the goal of the flock, set with world_goal.SetGoal() from any thread, its path field searched over the next steps
+inline PathField world_goal;
+
+// Weighted pull of the boids beyond the perception radius on boid i: toward their centers of mass and along
+// their velocity, every far boid counting for 1 / distance, so near flocks matter more than distant ones.
+inline Vector2 LongRangeForce(const std::vector<Boid> &boids, const Quadtree &tree, int i, const TickParams &p,
+                              float theta)
+{
+    FarField far = tree.Far(boids, boids[i].pos, p.radius, theta);
+    if (far.weight == 0)
+        return {0, 0};
+    Vector2 toward = far.toward * (1.0f / far.weight);
+    Vector2 ali = (far.vel * (1.0f / far.weight) - boids[i].vel) * (1.0f / p.max_speed);
+    return (toward + ali) * p.long_range_push;
+}
+
+// Predators hunting the flock. Each one chases the boid nearest to it, found through the grid of the flock, and
+// the boids flee the predators within fear_radius of them, found through a small grid of the predators alone,
+// so neither side loops over the other. Predators are Boids for the grids, their acc is unused.
+class PredatorPack
+{
+  public:
+    std::vector<Boid> agents;
+    std::vector<int> target; // boid chased by each predator, -1 when none is in sight
+    SpatialGrid grid;        // cells of fear_radius, so every predator a boid fears lies in the 3x3 block around it
+
+    // keeps the predators there are, new ones spawn anywhere in a world of width x height
+    void Resize(int count, float width, float height)
+    {
+        int old = (int) agents.size();
+        agents.resize(count);
+        target.resize(count, -1);
+        for (int p = old; p < count; p++)
+        {
+            agents[p].pos = (Vector2) {(float) (rand() % (int) width), (float) (rand() % (int) height)};
+            agents[p].vel = (Vector2) {((rand() % 100) / 50.0f - 1), ((rand() % 100) / 50.0f - 1)};
+            agents[p].acc = (Vector2) {0, 0};
+        }
+    }
+
+    // Turn every predator toward the nearest boid within HUNT_RADIUS and move it, then rebuild the predator grid.
+    // flock_grid indexes the boids where they are at the start of the step.
+    void Hunt(const std::vector<Boid> &boids, const SpatialGrid &flock_grid, const TickParams &p)
+    {
+        float top_speed = p.max_speed * PREDATOR_SPEED;
+        float turn = fminf(PREDATOR_TURN * p.dt, 1.0f);
+        ParallelFor(p, 0, (int) agents.size(), PREDATOR_CHUNK, [&](int begin, int end, int) {
+            for (int h = begin; h < end; h++)
+            {
+                Boid &hunter = agents[h];
+                target[h] = flock_grid.Nearest(boids, hunter.pos, HUNT_RADIUS);
+                // with no prey in sight, keep going the same way
+                if (target[h] >= 0)
+                {
+                    Vector2 wanted = Vector2Normalize(boids[target[h]].pos - hunter.pos) * top_speed;
+                    hunter.vel += (wanted - hunter.vel) * turn;
+                }
+                hunter.vel = Vector2ClampValue(hunter.vel, 0, top_speed);
+                hunter.pos = hunter.pos + hunter.vel;
+                if (p.wrap)
+                    hunter.WrapAroundWorld(p.world_width, p.world_height);
+                else
+                    hunter.ClampToWorld(p.world_width, p.world_height);
+            }
+        });
+        grid.Build(agents, p.world_width, p.world_height, p.fear_radius);
+    }
+
+    // weighted push of the predators within fear_radius on a boid at pos
+    Vector2 Fear(Vector2 pos, const TickParams &p) const
+    {
+        Vector2 force = {0, 0};
+        float r2 = p.fear_radius * p.fear_radius;
+        int cx = grid.CellX(pos.x), cy = grid.CellY(pos.y);
+        // most cells hold no predator, the 3x3 block is walked without sorting it first
+        for (int y = std::max(cy - 1, 0); y <= std::min(cy + 1, grid.rows - 1); y++)
+            for (int x = std::max(cx - 1, 0); x <= std::min(cx + 1, grid.cols - 1); x++)
+            {
+                int c = y * grid.cols + x;
+                for (int k = grid.CellBegin<false>(c); k != grid.CellEnd<false>(c); k++)
+                {
+                    Vector2 diff = pos - agents[grid.CellAgent<false>(k)].pos;
+                    float d2 = diff.x * diff.x + diff.y * diff.y;
+                    if (d2 < r2 && d2 > 0)
+                    {
+                        float d = sqrtf(d2);
+                        force += diff * (1.0f / (d * (d + 0.001f)));
+                    }
+                }
+            }
+        return force * p.fear_push;
+    }
+};
+
+// the predators of the flock, moved by every step while Settings::predator_count > 0
+inline PredatorPack predator_pack;
+
+// Compute the steering force of every boid into Boid::acc, without moving anything.
+// Tasks are ranges of grid cells, so a task works on boids that are close to each other.
+// With groups > 1, only the boids i with i % groups == step % groups are steered, the others keep their acc.
+// With a view, boids are steered according to their LOD tier. With a tree, the long-range term is added.
+// With the species of every boid, every boid takes the pairwise gather, which weighs neighbours with species_matrix,
+// as the gathers from cell sums (cell sums mode, the far LOD tier) can't tell the species apart.
+// With predators, the boids near them are pushed away.
+template <typename Kernel>
+inline void ComputeSteeringWith(std::vector<Boid> &boids, const SpatialGrid &grid, const TickParams &p, int groups,
+                                long long step, const ViewRect *view, const Quadtree *tree, const uint8_t *species,
+                                const PredatorPack *hunters)
+{
+    std::atomic<int> capped_boids{0}, steered_boids{0};
+    std::atomic<int> tier_boids[LOD_TIERS] = {};
+    bool cell_sums = p.cell_sums;
+    bool aggregate = view && !species;
+    const CellSum *sums = aggregate || cell_sums ? SumCells(boids, grid, p) : nullptr;
+    int cells = grid.cols * grid.rows;
+    int grain = (int) ((long long) cells * STEER_CHUNK * groups / (boids.empty() ? 1 : boids.size()));
+    ParallelFor(p, 0, cells, grain > 0 ? grain : 1, [&](int c0, int c1, int) {
+        int capped_here = 0, steered_here = 0;
+        int tier_here[LOD_TIERS] = {0};
+        for (int c = c0; c < c1; c++)
+            grid.ForEachInCell(c, [&](int i) {
+                int tier = view ? BoidLodTier(boids[i].pos, *view, p.radius) : LOD_FULL;
+                tier_here[tier]++;
+                int period = tier == LOD_FULL ? groups : groups * LOD_RATE;
+                if (period > 1 && i % period != step % period)
+                    return true;
+                steered_here++;
+                if (tier == LOD_AGGREGATE && aggregate)
+                    boids[i].acc = SteerBoidAggregate<Kernel>(boids, grid, sums, i, p);
+                else if (cell_sums && !species)
+                    boids[i].acc = SteerBoidSums<Kernel>(boids, grid, sums, i, p);
+                else
+                {
+                    bool capped;
+                    if (species)
+                        boids[i].acc = SteerBoid<Kernel>(boids, grid, i, p, &capped,
+                                                         SpeciesRules(SpeciesFlocking(p, species, i)));
+                    else
+                        boids[i].acc = SteerBoid<Kernel>(boids, grid, i, p, &capped, FlockRules(p));
+                    if (capped)
+                        capped_here++;
+                }
+                if (tree)
+                    boids[i].acc += LongRangeForce(boids, *tree, i, p, p.theta);
+                if (hunters)
+                    boids[i].acc += hunters->Fear(boids[i].pos, p);
+                return true;
+            });
+        capped_boids.fetch_add(capped_here, std::memory_order_relaxed);
+        steered_boids.fetch_add(steered_here, std::memory_order_relaxed);
+        for (int t = 0; t < LOD_TIERS; t++)
+            tier_boids[t].fetch_add(tier_here[t], std::memory_order_relaxed);
+    });
+    Stats::capped_boids = capped_boids;
+    Stats::steered_boids = steered_boids;
+    for (int t = 0; t < LOD_TIERS; t++)
+        Stats::lod_boids[t] = tier_boids[t];
+    Stats::capped_total += Stats::capped_boids;
+    if (Stats::capped_boids > 0)
+        Stats::capped_frames++;
+}
+
+inline void ComputeSteering(std::vector<Boid> &boids, const SpatialGrid &grid, const TickParams &p, int groups = 1,
+                            long long step = 0, const ViewRect *view = nullptr, const Quadtree *tree = nullptr,
+                            const uint8_t *species = nullptr, const PredatorPack *hunters = nullptr)
+{
+    DispatchKernel(p, [&](auto kernel) {
+        ComputeSteeringWith<decltype(kernel)>(boids, grid, p, groups, step, view, tree, species, hunters);
+    });
+}
+
+template <typename Boundary> inline void MoveFlockWith(std::vector<Boid> &boids, const TickParams &p)
+{
+    ParallelFor(p, 0, (int) boids.size(), BOID_CHUNK, [&](int begin, int end, int) {
+        for (int i = begin; i < end; i++)
+        {
+            Boid &b = boids[i];
+            b.vel += b.acc * p.dt;
+            b.vel = Vector2ClampValue(b.vel, 0, p.max_speed);
+            b.pos = b.pos + b.vel;
+            Boundary::Apply(b, p);
+        }
+    });
+}
+
+inline void MoveFlock(std::vector<Boid> &boids, const TickParams &p)
+{
+    if (p.wrap)
+        MoveFlockWith<WrapBoundary>(boids, p);
+    else
+        MoveFlockWith<ClampBoundary>(boids, p);
+}
+
+inline void BuildGrid(const std::vector<Boid> &boids, SpatialGrid &grid, const TickParams &p)
+{
+    // cell sums need cells that fit in the perception range, the pairwise gather only needs the 3x3 block
+    float cell = p.cell_sums ? p.radius / SUM_SPLIT : p.radius;
+    grid.Resize(p.world_width, p.world_height, cell, (int) boids.size());
+    ParallelFor(p, 0, (int) boids.size(), BOID_CHUNK,
+                [&](int begin, int end, int) { grid.AssignCells(boids, begin, end); });
+    if (p.incremental_grid)
+    {
+        // a boid moves by at most max_speed per step, most of them stay in their cell
+        grid.Relink();
+        Stats::grid_migrated = grid.migrated;
+    }
+    else if (p.backend == BACKEND_SERIAL || ThreadCount(p.threads) == 1)
+        grid.Sort();
+    else
+        grid.SortParallel(ThreadCount(p.threads), [&](int blocks, auto &&fn) {
+            ParallelFor(p, 0, blocks, 1, [&](int begin, int end, int) {
+                for (int b = begin; b < end; b++)
+                    fn(b);
+            });
+        });
+}
+
+// A step is steady when the last steps ran on the same grid with the same flock size, world and threads, and
+// the frame arena and the buffers of the fields had room: every buffer already has its size, and such a step must
+// not touch the heap.
+inline bool SteadyStep(int boid_count, const SpatialGrid &grid, const TickParams &p, bool grew)
+{
+    static int last[4] = {-1, -1, -1, -1};
+    static int steady_steps = 0;
+    int now[4] = {boid_count, grid.cols * grid.rows, p.backend, p.threads};
+    bool same = memcmp(now, last, sizeof(now)) == 0;
+    memcpy(last, now, sizeof(now));
+    steady_steps = same && !grew ? steady_steps + 1 : 0;
+    // the first steps after a change may still size some vectors on their first use
+    return steady_steps >= 2 && grid.builds > 2;
+}
+
+// One simulation step, with the settings and frame inputs of p. The grid indexes positions at the start of the
+// step, so all forces are computed before any boid moves. view is the camera view for LOD, none means all in view.
+// species holds the species id of every boid, used while p.species > 1.
+inline void StepFlock(std::vector<Boid> &boids, SpatialGrid &grid, const TickParams &tick,
+                      const ViewRect *view = nullptr, const uint8_t *species = nullptr)
+{
+#ifdef BOIDS_COUNT_ALLOCATIONS
+    long long allocations = heap_allocations;
+#endif
+    TickParams p = tick;
+    if (p.backend == BACKEND_POOL)
+        SimPool(p.threads, p.affinity).ResetStats();
+    // the obstacles are only baked again after an edit
+    double ts = NowMs();
+    if (world_obstacles.Update(SDF_CELL, OBSTACLE_TOL + 2 * SDF_CELL))
+        Stats::sdf_ms = NowMs() - ts;
+    bool fields_grew = false;
+    p.obstacles = world_obstacles.field.Empty() ? nullptr : &world_obstacles.field;
+    // the wind is whichever grid the generator finished last, the step doesn't wait for a newer one
+    if (p.wind_push != 0)
+    {
+        p.wind = world_wind.Update(p.world_width, p.world_height);
+        Stats::wind_ms = world_wind.GenerateMs();
+    }
+    // the search toward a moved goal runs PATH_BUDGET nodes per step, the flock follows the last complete one meanwhile
+    if (p.goal_push != 0)
+    {
+        double tp = NowMs();
+        p.goal = world_goal.Update(p.obstacles, world_obstacles.Baked(), p.world_width, p.world_height, PATH_BUDGET);
+        Stats::path_ms = p.goal || world_goal.Searching() ? NowMs() - tp : 0.0;
+        fields_grew |= world_goal.Grew();
+    }
+    double t0 = NowMs();
+    BuildGrid(boids, grid, p);
+    double tg = NowMs();
+    // the density map reads the counts of the cells the build just made
+    if (p.heatmap)
+        flock_density.Update(grid, p.dt);
+    else if (!flock_density.Empty())
+        flock_density.Clear();
+    double tq = NowMs();
+    const Quadtree *tree = nullptr;
+    if (p.long_range_push > 0)
+    {
+        flock_tree.Build(boids, p.world_width, p.world_height);
+        tree = &flock_tree;
+    }
+    double th = NowMs();
+    // predators chase the boids where they are now, the boids flee the predators where they went
+    const PredatorPack *hunters = nullptr;
+    predator_pack.Resize(p.predator_count, p.world_width, p.world_height);
+    if (p.predator_count > 0)
+    {
+        predator_pack.Hunt(boids, grid, p);
+        hunters = &predator_pack;
+    }
+    double t1 = NowMs();
+    // the grid is rebuilt every step all the same, the steered boids see where everyone is now
+    if (p.species > 1 && species_matrix.Count() != p.species)
+        species_matrix.Reset(p.species);
+    ComputeSteering(boids, grid, p, p.groups, Stats::steps, p.lod ? view : nullptr, tree,
+                    p.species > 1 ? species : nullptr, hunters);
+    double t2 = NowMs();
+    MoveFlock(boids, p);
+    double t3 = NowMs();
+    Stats::grid_ms = tg - t0;
+    Stats::heat_ms = tq - tg;
+    Stats::tree_ms = th - tq;
+    Stats::hunt_ms = t1 - th;
+    Stats::steer_ms = t2 - t1;
+    Stats::move_ms = t3 - t2;
+    Stats::steps++;
+
+    Stats::worker_busy_ms.clear();
+    Stats::worker_idle_ms.clear();
+    if (p.backend == BACKEND_POOL)
+    {
+        for (int w = 0; w < sim_pool->Size(); w++)
+        {
+            Stats::worker_busy_ms.push_back(sim_pool->busy_ms[w]);
+            Stats::worker_idle_ms.push_back(sim_pool->IdleMs(w));
+        }
+    }
+
+    // the scratch of this step is not needed anymore
+    bool arena_grew = frame_arena.Reset();
+    Stats::arena_kb = frame_arena.LastUsed() / 1024.0;
+    Stats::arena_high_water_kb = frame_arena.HighWater() / 1024.0;
+#ifdef BOIDS_COUNT_ALLOCATIONS
+    Stats::heap_allocations = heap_allocations - allocations; // of this thread only
+    bool steady = SteadyStep((int) boids.size(), grid, p, arena_grew || fields_grew);
+    assert(!steady || Stats::heap_allocations == 0);
+#else
+    (void) arena_grew;
+    (void) fields_grew;
+#endif
+}
+
+// One simulation step with the current settings
+inline void StepFlock(std::vector<Boid> &boids, SpatialGrid &grid, Vector2 mouse_pos, float deltaTime,
+                      const ViewRect *view = nullptr, const uint8_t *species = nullptr)
+{
+    StepFlock(boids, grid, MakeTickParams(mouse_pos, deltaTime), view, species);
+}
+
+#endif // BOIDS_CORE_H
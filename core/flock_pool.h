@@ -0,0 +1,252 @@
+/* Flock of a changing size, for spawning and removing boids while the simulation runs
+ * The boids live in a vector reserved to the pool capacity once, kept dense so
+ * every pass of a step runs over it unchanged, and never reallocated. The
+ * per-boid data the steps never read (species, color, energy, handle) sits in
+ * arrays of its own, in the same order, so it stays out of the physics loops. Each
+ * boid also holds a slot, whose handle stays valid for as long as the boid
+ * lives; freed slots are reused through a free list, with a generation count
+ * so that a stale handle never reaches the boid that took its slot over.
+ * Any thread can queue spawn/despawn commands through a lock-free bounded
+ * queue, the simulation thread applies them between two ticks.
+ */
+
+#ifndef FLOCK_POOL_H
+#define FLOCK_POOL_H
+
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+#include "boids_core.h"
+
+#define COMMAND_QUEUE_SIZE 4096 // power of two, commands pushed while the queue is full are dropped
+#define SLOT_BITS 24            // a handle is the slot index in the low bits, and its generation above them
+
+// same layout as raylib's Color, the core doesn't depend on raylib itself
+struct BoidColor
+{
+    unsigned char r, g, b, a;
+};
+
+// color a boid is given when it spawns
+inline BoidColor SpeciesColor(int species)
+{
+    static const BoidColor palette[] = {{245, 245, 245, 255}, {230, 41, 55, 255},  {0, 121, 241, 255},
+                                        {253, 249, 0, 255},   {0, 228, 48, 255},   {200, 122, 255, 255},
+                                        {255, 161, 0, 255},   {102, 191, 255, 255}};
+    return palette[species % (int) (sizeof(palette) / sizeof(palette[0]))];
+}
+
+enum FlockCommandType
+{
+    CMD_SPAWN,        // a boid at pos, moving at vel
+    CMD_DESPAWN,      // the boid of handle, if it is still alive
+    CMD_DESPAWN_AREA, // every boid within radius of pos
+};
+
+struct FlockCommand
+{
+    int type;
+    Vector2 pos;
+    Vector2 vel;
+    float radius;
+    uint32_t handle;
+    int species;
+};
+
+// Bounded multi producer, single consumer queue. Every cell carries a sequence number telling whether it is
+// free for the producer of that lap or filled for the consumer, so producers only contend on one counter and
+// never wait on each other.
+class CommandQueue
+{
+  public:
+    CommandQueue()
+    {
+        for (int i = 0; i < COMMAND_QUEUE_SIZE; i++)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    // any thread, returns false when the queue is full
+    bool TryPush(const FlockCommand &command)
+    {
+        uint64_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell &cell = cells[pos & (COMMAND_QUEUE_SIZE - 1)];
+            int64_t lag = (int64_t) cell.sequence.load(std::memory_order_acquire) - (int64_t) pos;
+            if (lag == 0)
+            {
+                // the cell is free for this lap, claim it
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.command = command;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (lag < 0)
+                return false; // the consumer hasn't emptied it yet since the last lap
+            else
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+    // consumer thread only
+    bool TryPop(FlockCommand &command)
+    {
+        Cell &cell = cells[dequeue_pos & (COMMAND_QUEUE_SIZE - 1)];
+        if (cell.sequence.load(std::memory_order_acquire) != dequeue_pos + 1)
+            return false;
+        command = cell.command;
+        cell.sequence.store(dequeue_pos + COMMAND_QUEUE_SIZE, std::memory_order_release);
+        dequeue_pos++;
+        return true;
+    }
+
+  private:
+    struct Cell
+    {
+        std::atomic<uint64_t> sequence;
+        FlockCommand command;
+    };
+    Cell cells[COMMAND_QUEUE_SIZE];
+    alignas(64) std::atomic<uint64_t> enqueue_pos{0};
+    alignas(64) uint64_t dequeue_pos = 0;
+};
+
+class FlockPool
+{
+  public:
+    std::vector<Boid> boids; // live boids, dense, the flock every step runs over
+
+    // cold data of the same boids, same order
+    std::vector<uint8_t> species;
+    std::vector<BoidColor> color;
+    std::vector<float> energy;
+
+    // counters since the start, written by the simulation thread
+    long long spawned = 0;
+    long long despawned = 0;
+    long long rejected = 0;            // spawns that found the pool full, or had a species out of range
+    std::atomic<long long> dropped{0}; // commands that found the queue full
+
+    FlockPool(int capacity)
+    {
+        boids.reserve(capacity);
+        species.reserve(capacity);
+        color.reserve(capacity);
+        energy.reserve(capacity);
+        handle_of.reserve(capacity);
+        index_of.assign(capacity, -1);
+        generation.assign(capacity, 0);
+        free_slots.reserve(capacity);
+        for (int s = capacity - 1; s >= 0; s--)
+            free_slots.push_back(s);
+    }
+
+    int Capacity() const { return (int) index_of.size(); }
+    int Count() const { return (int) boids.size(); }
+    uint32_t Handle(int index) const { return handle_of[index]; }
+
+    // --- any thread ---
+    bool Push(const FlockCommand &command)
+    {
+        if (commands.TryPush(command))
+            return true;
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    // kind is the species, below MAX_SPECIES, the spawn is refused otherwise
+    bool Spawn(Vector2 pos, Vector2 vel, int kind = 0)
+    {
+        if (kind < 0 || kind >= MAX_SPECIES)
+            return false;
+        return Push({CMD_SPAWN, pos, vel, 0.0f, 0, kind});
+    }
+    bool Despawn(uint32_t handle) { return Push({CMD_DESPAWN, {0, 0}, {0, 0}, 0.0f, handle, 0}); }
+    bool DespawnArea(Vector2 pos, float radius) { return Push({CMD_DESPAWN_AREA, pos, {0, 0}, radius, 0, 0}); }
+
+    // --- simulation thread, between two ticks ---
+    // applies the queued commands, returns how many. At most a queue's worth is taken, so that
+    // producers pushing faster than the commands are applied can't keep the tick from starting.
+    int Apply()
+    {
+        FlockCommand command;
+        int applied = 0;
+        while (applied < COMMAND_QUEUE_SIZE && commands.TryPop(command))
+        {
+            applied++;
+            if (command.type == CMD_SPAWN)
+            {
+                Boid b;
+                b.pos = command.pos;
+                b.vel = command.vel;
+                Add(b, command.species);
+            }
+            else if (command.type == CMD_DESPAWN)
+            {
+                int slot = command.handle & ((1 << SLOT_BITS) - 1);
+                if (slot < Capacity() && index_of[slot] >= 0 && handle_of[index_of[slot]] == command.handle)
+                    Remove(index_of[slot]);
+            }
+            else if (command.type == CMD_DESPAWN_AREA)
+            {
+                // backwards, as Remove() moves the last boid into the hole
+                float r2 = command.radius * command.radius;
+                for (int i = Count() - 1; i >= 0; i--)
+                    if (Vector2DistanceSqr(boids[i].pos, command.pos) < r2)
+                        Remove(i);
+            }
+        }
+        return applied;
+    }
+    // adds a boid of species kind right away, returns false when the pool is full or kind is not below MAX_SPECIES
+    bool Add(Boid b, int kind = 0)
+    {
+        if (free_slots.empty() || kind < 0 || kind >= MAX_SPECIES)
+        {
+            rejected++;
+            return false;
+        }
+        int slot = free_slots.back();
+        free_slots.pop_back();
+        b.acc = {0, 0};
+        index_of[slot] = Count();
+        boids.push_back(b);
+        species.push_back((uint8_t) kind);
+        color.push_back(SpeciesColor(kind));
+        energy.push_back(1.0f);
+        handle_of.push_back(((uint32_t) generation[slot] << SLOT_BITS) | (uint32_t) slot);
+        spawned++;
+        return true;
+    }
+    // removes the boid at index right away, the last boid takes its place
+    void Remove(int index)
+    {
+        int slot = handle_of[index] & ((1 << SLOT_BITS) - 1);
+        int last = Count() - 1;
+        boids[index] = boids[last];
+        species[index] = species[last];
+        color[index] = color[last];
+        energy[index] = energy[last];
+        handle_of[index] = handle_of[last];
+        index_of[handle_of[index] & ((1 << SLOT_BITS) - 1)] = index;
+        boids.pop_back();
+        species.pop_back();
+        color.pop_back();
+        energy.pop_back();
+        handle_of.pop_back();
+        index_of[slot] = -1;
+        generation[slot] = (generation[slot] + 1) & ((1 << (32 - SLOT_BITS)) - 1);
+        free_slots.push_back(slot);
+        despawned++;
+    }
+
+  private:
+    CommandQueue commands;
+    std::vector<uint32_t> handle_of; // handle of every live boid, same order as boids
+    std::vector<int> index_of;       // per slot, index of its boid in boids, -1 when free
+    std::vector<int> generation;     // per slot, bumped every time it is freed
+    std::vector<int> free_slots;
+};
+
+#endif // FLOCK_POOL_H
@@ -0,0 +1,210 @@
+/* Wind, a flow field generated in the background
+ * The wind is the curl of an animated gradient noise, which makes it swirl
+ * without sources or sinks. Evaluating it per boid means hashing the 8
+ * corners of a noise cell, so instead a thread of its own samples it on a
+ * coarse grid of nodes over the world, FLOW_HZ times per second, and hands the
+ * grids over through a triple buffer. A boid reads the wind from the 4 nodes around it (bilinear), from
+ * whichever grid was the latest at the start of the step.
+ */
+
+#ifndef FLOW_FIELD_H
+#define FLOW_FIELD_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <math.h>
+#include <mutex>
+#include <raymath.h>
+#include <thread>
+#include <vector>
+
+#include "triple_buffer.h"
+
+#define FLOW_CELL 40.0f           // node spacing of the wind grid
+#define FLOW_SCALE (1.0f / 400.0f) // noise periods per world unit, the size of the swirls
+#define FLOW_SPEED 0.2f           // noise periods per second, how fast the swirls change
+#define FLOW_HZ 15                // wind grids generated per second
+#define FLOW_MAX_NODES (64 * 1024) // the node spacing grows past this, for huge worlds
+
+// --- gradient noise ---
+inline unsigned NoiseHash(int x, int y, int z)
+{
+    unsigned h = (unsigned) x * 73856093u ^ (unsigned) y * 19349663u ^ (unsigned) z * 83492791u;
+    h ^= h >> 13;
+    h *= 0x5bd1e995u;
+    return h ^ (h >> 15);
+}
+
+// the 12 edge directions of a cube, 4 of them twice, picked by the low bits of a hash
+inline const float NOISE_GRADIENTS[16][3] = {
+    {1, 1, 0}, {-1, 1, 0}, {1, -1, 0}, {-1, -1, 0}, {1, 0, 1},  {-1, 0, 1},  {1, 0, -1}, {-1, 0, -1},
+    {0, 1, 1}, {0, -1, 1}, {0, 1, -1}, {0, -1, -1}, {1, 1, 0}, {1, -1, 0}, {-1, 1, 0}, {-1, -1, 0},
+};
+
+// Gradient (d/dx, d/dy) of Perlin's improved noise at (x, y, z), derived in closed form along with the
+// interpolation, so it costs one noise evaluation instead of the 4 of finite differences.
+inline Vector2 NoiseGradient(float x, float y, float z)
+{
+    float fx = floorf(x), fy = floorf(y), fz = floorf(z);
+    int ix = (int) fx, iy = (int) fy, iz = (int) fz;
+    x -= fx;
+    y -= fy;
+    z -= fz;
+    auto fade = [](float t) { return t * t * t * (t * (t * 6 - 15) + 10); };
+    auto slope = [](float t) { return 30 * t * t * (t - 1) * (t - 1); };
+    float u = fade(x), v = fade(y), w = fade(z);
+    float du = slope(x), dv = slope(y);
+    Vector2 grad = {0, 0};
+    for (int k = 0; k < 2; k++)
+        for (int j = 0; j < 2; j++)
+            for (int i = 0; i < 2; i++)
+            {
+                const float *g = NOISE_GRADIENTS[NoiseHash(ix + i, iy + j, iz + k) & 15];
+                float n = g[0] * (x - i) + g[1] * (y - j) + g[2] * (z - k);
+                float wx = i ? u : 1 - u, wy = j ? v : 1 - v, wz = k ? w : 1 - w;
+                float dwx = i ? du : -du, dwy = j ? dv : -dv;
+                grad.x += (dwx * n + wx * g[0]) * wy * wz;
+                grad.y += (dwy * n + wy * g[1]) * wx * wz;
+            }
+    return grad;
+}
+
+// curl of the noise at (x, y) and time t, in noise units: (dn/dy, -dn/dx), about 0 to 2.5 long
+inline Vector2 CurlNoise(float x, float y, float t)
+{
+    Vector2 grad = NoiseGradient(x, y, t);
+    return (Vector2) {grad.y, -grad.x};
+}
+
+// wind at the world position p and time t (in seconds), straight from the noise
+inline Vector2 WindAt(Vector2 p, float t) { return CurlNoise(p.x * FLOW_SCALE, p.y * FLOW_SCALE, t * FLOW_SPEED); }
+// --- ---
+
+// A vector sampled every cell world units over the world, the wind here (and the way to the goal of
+// core/path_field.h)
+class FlowGrid
+{
+  public:
+    float x0 = 0, y0 = 0;   // world position of node (0, 0)
+    float cell = 1;         // node spacing
+    int cols = 0, rows = 0; // nodes per row and per column, at least 2 once sized
+    float time = 0;         // of the noise, in seconds
+    std::vector<Vector2> v;
+
+    // Nodes every spacing world units over a world of width x height, the vector only grows with the world
+    void Resize(float width, float height, float spacing)
+    {
+        x0 = y0 = 0;
+        cell = spacing;
+        cols = std::max(2, (int) ceilf(width / cell) + 1);
+        rows = std::max(2, (int) ceilf(height / cell) + 1);
+        v.resize((size_t) cols * rows);
+    }
+
+    // world position of node (x, y)
+    Vector2 Node(int x, int y) const { return {x0 + x * cell, y0 + y * cell}; }
+
+    // Samples the wind at time t over a world of width x height
+    void Generate(float width, float height, float t)
+    {
+        Resize(width, height, fmaxf(FLOW_CELL, sqrtf(width * height / FLOW_MAX_NODES)));
+        time = t;
+        for (int y = 0; y < rows; y++)
+            for (int x = 0; x < cols; x++)
+                v[(size_t) y * cols + x] = WindAt(Node(x, y), t);
+    }
+
+    bool Empty() const { return v.empty(); }
+
+    // bilinear vector at p, the nearest edge of the grid outside of it
+    Vector2 Lookup(Vector2 p) const
+    {
+        float fx = Clamp((p.x - x0) / cell, 0.0f, (float) (cols - 1));
+        float fy = Clamp((p.y - y0) / cell, 0.0f, (float) (rows - 1));
+        int x = std::min((int) fx, cols - 2), y = std::min((int) fy, rows - 2);
+        float u = fx - x, w = fy - y;
+        const Vector2 *row = v.data() + (size_t) y * cols + x;
+        Vector2 top = row[0] + (row[1] - row[0]) * u;
+        Vector2 bottom = row[cols] + (row[cols + 1] - row[cols]) * u;
+        return top + (bottom - top) * w;
+    }
+};
+
+// The thread generating the wind grids. It starts on the first Update(), and only generates grids while someone
+// keeps asking for them, so it sleeps while the wind is off.
+class FlowField
+{
+  public:
+    ~FlowField()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stop = true;
+        }
+        wake.notify_one();
+        if (worker.joinable())
+            worker.join();
+    }
+
+    // Asks for the wind over a world of width x height. Returns the latest grid, which stays valid until the
+    // next call, or nullptr until the first one is ready. Only call from one thread.
+    const FlowGrid *Update(float width, float height)
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            world_width = width;
+            world_height = height;
+            wanted = true;
+            if (!worker.joinable())
+                worker = std::thread([this] { Run(); });
+        }
+        wake.notify_one();
+        grids.Update();
+        return grids.Front().Empty() ? nullptr : &grids.Front();
+    }
+
+    // time the last grid took to generate
+    double GenerateMs() const { return generate_ms.load(std::memory_order_relaxed); }
+
+  private:
+    void Run()
+    {
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point start = Clock::now(), next = start;
+        std::unique_lock<std::mutex> guard(lock);
+        while (!stop)
+        {
+            // asleep until asked, then at most FLOW_HZ grids per second
+            wake.wait(guard, [&] { return stop || wanted; });
+            if (stop)
+                break;
+            if (wake.wait_until(guard, next, [&] { return stop; }))
+                break;
+            wanted = false;
+            float width = world_width, height = world_height;
+            guard.unlock();
+
+            Clock::time_point t0 = Clock::now();
+            grids.Back().Generate(width, height, std::chrono::duration<float>(t0 - start).count());
+            grids.Publish();
+            Clock::time_point t1 = Clock::now();
+            generate_ms.store(std::chrono::duration<double, std::milli>(t1 - t0).count(), std::memory_order_relaxed);
+            next = t0 + std::chrono::microseconds(1000000 / FLOW_HZ);
+
+            guard.lock();
+        }
+    }
+
+    TripleBuffer<FlowGrid> grids;
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stop = false;
+    bool wanted = false;
+    float world_width = 0, world_height = 0;
+    std::atomic<double> generate_ms{0.0};
+};
+
+#endif // FLOW_FIELD_H
@@ -0,0 +1,121 @@
+/* Linear allocator for the scratch memory of a simulation tick
+ * Every buffer a tick needs only while it runs (cell of every boid, sort keys
+ * and histograms, candidate lists) is bumped out of one block, and the whole
+ * block is given back at once at the end of the tick. When a tick needs more
+ * than the block holds, the rest comes from the heap, and the block grows to
+ * the high-water mark at the next reset, so a flock of a steady size stops
+ * touching the heap after its first ticks.
+ */
+
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <stdlib.h>
+#include <type_traits>
+#include <vector>
+
+#define ARENA_ALIGN 64 // every allocation starts on its own cache line
+
+class FrameArena
+{
+  public:
+    FrameArena() {}
+    ~FrameArena()
+    {
+        Reset();
+        free(block);
+    }
+    FrameArena(const FrameArena &) = delete;
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    // Room for n T's, uninitialized, valid until the next Reset(). Can be called from any thread.
+    template <typename T> T *Alloc(size_t n)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "the arena never runs constructors or destructors");
+        size_t bytes = (n * sizeof(T) + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+        size_t offset = used.fetch_add(bytes, std::memory_order_relaxed);
+        if (offset + bytes <= capacity)
+            return (T *) (block + offset);
+        // the block is full this tick, fall back on the heap
+        void *spill = aligned_alloc(ARENA_ALIGN, bytes > 0 ? bytes : ARENA_ALIGN);
+        if (!spill)
+            throw std::bad_alloc();
+        std::lock_guard<std::mutex> guard(spill_lock);
+        spills.push_back(spill);
+        return (T *) spill;
+    }
+
+    // Gives everything back, between two ticks, when nothing allocated from the arena is in use anymore.
+    // Returns true if the block had to grow, i.e. this tick went to the heap.
+    bool Reset()
+    {
+        size_t demand = used.load(std::memory_order_relaxed);
+        high_water = demand > high_water ? demand : high_water;
+        last_used = demand;
+        used.store(0, std::memory_order_relaxed);
+        for (void *spill : spills)
+            free(spill);
+        spills.clear();
+        if (high_water <= capacity)
+            return false;
+        // a bit of headroom, so a flock growing slowly doesn't regrow it every tick
+        free(block);
+        capacity = (high_water + high_water / 4 + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+        block = (char *) aligned_alloc(ARENA_ALIGN, capacity);
+        if (!block)
+            throw std::bad_alloc();
+        grows++;
+        return true;
+    }
+
+    size_t Capacity() const { return capacity; }
+    size_t LastUsed() const { return last_used; }   // bytes taken by the last tick
+    size_t HighWater() const { return high_water; } // most bytes a tick ever took
+    int Grows() const { return grows; }
+
+  private:
+    char *block = nullptr;
+    size_t capacity = 0;
+    std::atomic<size_t> used{0};
+    size_t last_used = 0;
+    size_t high_water = 0;
+    int grows = 0;
+    std::mutex spill_lock;
+    std::vector<void *> spills;
+};
+
+// the arena of the simulation steps, reset at the end of every step
+inline FrameArena frame_arena;
+
+#ifdef BOIDS_COUNT_ALLOCATIONS
+// Counts the operator new calls of every thread on its own, so that a step can check it didn't allocate without
+// counting what the GUI, the renderer or the wind thread allocate meanwhile. The workers of a step draw their
+// scratch from the arena, which the stepping thread sizes, so the count of the stepping thread is the one to check.
+// This replaces the global operator new, so only include it with BOIDS_COUNT_ALLOCATIONS in programs that
+// are a single translation unit (all of them in this repo).
+inline thread_local long long heap_allocations = 0;
+
+// these are the new and delete of the whole program, so the malloc behind one is always freed by the other: GCC
+// only sees a malloc'd pointer reach free() through operator delete once they are inlined
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void *operator new(size_t bytes)
+{
+    heap_allocations++;
+    void *p = malloc(bytes > 0 ? bytes : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+void *operator new[](size_t bytes) { return operator new(bytes); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+#pragma GCC diagnostic pop
+#endif
+
+#endif // FRAME_ARENA_H
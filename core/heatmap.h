@@ -0,0 +1,57 @@
+/* Density of the flock over the world, smoothed over time
+ * The neighbour grid already counts the boids of every cell when it is built,
+ * so the density map reads those counts instead of splatting the boids again:
+ * one pass over the cells per step, whatever the number of boids. Each cell
+ * then moves toward its new density by an exponential moving average, with a
+ * time constant of HEAT_TAU seconds whatever the frame rate, which hides the
+ * flicker of boids crossing cell borders.
+ */
+
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include <math.h>
+#include <vector>
+
+#include "spatial_grid.h"
+
+#define HEAT_TAU 0.5f // seconds for the map to move most of the way (63%) to a new density
+
+class DensityMap
+{
+  public:
+    float origin_x = 0, origin_y = 0; // world position of the top left corner of cell 0
+    float cell_size = 1;
+    int cols = 0, rows = 0;
+    std::vector<float> density; // smoothed boids per square world unit, by cell
+
+    // Moves the map dt seconds toward the counts of the grid. When the cells of the grid changed (world size,
+    // perception radius, cell sums), the map starts over from the counts.
+    void Update(const SpatialGrid &grid, float dt)
+    {
+        float area = grid.cell_size * grid.cell_size;
+        float blend = 1.0f - expf(-dt / HEAT_TAU);
+        if (grid.cols != cols || grid.rows != rows || grid.cell_size != cell_size || grid.origin_x != origin_x ||
+            grid.origin_y != origin_y || density.empty())
+        {
+            origin_x = grid.origin_x;
+            origin_y = grid.origin_y;
+            cell_size = grid.cell_size;
+            cols = grid.cols;
+            rows = grid.rows;
+            density.resize((size_t) cols * rows);
+            blend = 1.0f;
+        }
+        for (int c = 0; c < cols * rows; c++)
+            density[c] += (grid.CellCount(c) / area - density[c]) * blend;
+    }
+
+    void Clear()
+    {
+        cols = rows = 0;
+        density.clear();
+    }
+    bool Empty() const { return density.empty(); }
+};
+
+#endif // HEATMAP_H
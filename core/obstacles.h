@@ -0,0 +1,281 @@
+/* Static obstacles, baked into a signed distance field
+ * Obstacles are circles and polygons, loaded from a text file or placed by
+ * hand. They are not tested one by one per boid: whenever they change, the
+ * signed distance to the nearest obstacle (negative inside) is sampled once on
+ * a grid of nodes over their bounding box, and a boid reads its distance and
+ * the gradient from the 4 nodes around it (bilinear), whatever the number of
+ * obstacles. Only the nodes within `range` of a shape are computed, the others
+ * stay at `range`, as nothing further away pushes anyone.
+ */
+
+#ifndef OBSTACLES_H
+#define OBSTACLES_H
+
+#include <algorithm>
+#include <math.h>
+#include <mutex>
+#include <raymath.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#define SDF_MAX_NODES (4 * 1024 * 1024) // the node spacing grows past this, for huge worlds
+
+struct ObstacleCircle
+{
+    Vector2 center;
+    float radius;
+};
+
+// closed, in either winding, may be concave
+struct ObstaclePolygon
+{
+    std::vector<Vector2> points;
+};
+
+// distance from p to the segment [a, b]
+inline float SegmentDistance(Vector2 p, Vector2 a, Vector2 b)
+{
+    Vector2 ab = b - a, ap = p - a;
+    float len2 = ab.x * ab.x + ab.y * ab.y;
+    float t = len2 > 0 ? Clamp((ap.x * ab.x + ap.y * ab.y) / len2, 0.0f, 1.0f) : 0.0f;
+    return Vector2Length(ap - ab * t);
+}
+
+// signed distance from p to the polygon, negative inside (even-odd rule)
+inline float PolygonDistance(Vector2 p, const ObstaclePolygon &poly)
+{
+    const std::vector<Vector2> &v = poly.points;
+    float d = INFINITY;
+    bool inside = false;
+    for (size_t i = 0, j = v.size() - 1; i < v.size(); j = i++)
+    {
+        d = fminf(d, SegmentDistance(p, v[j], v[i]));
+        if ((v[i].y > p.y) != (v[j].y > p.y) && p.x < v[j].x + (p.y - v[j].y) / (v[i].y - v[j].y) * (v[i].x - v[j].x))
+            inside = !inside;
+    }
+    return inside ? -d : d;
+}
+
+// The shapes, as the owner edits them
+struct ObstacleSet
+{
+    std::vector<ObstacleCircle> circles;
+    std::vector<ObstaclePolygon> polygons;
+
+    bool Empty() const { return circles.empty() && polygons.empty(); }
+
+    // Reads the shapes of a text file, one per line, in world coordinates:
+    //     circle x y radius
+    //     polygon x1 y1 x2 y2 x3 y3 ...
+    // Blank lines and lines starting with # are skipped. Returns false if the file can't be opened,
+    // malformed lines are reported on stderr and skipped.
+    bool Load(const char *path)
+    {
+        FILE *file = fopen(path, "r");
+        if (!file)
+            return false;
+        char line[4096];
+        int number = 0;
+        while (fgets(line, sizeof(line), file))
+        {
+            number++;
+            char *at = line + strspn(line, " \t");
+            if (*at == '#' || *at == '\n' || *at == '\r' || *at == 0)
+                continue;
+            char kind[16];
+            int used = 0;
+            if (sscanf(at, "%15s%n", kind, &used) != 1)
+                continue;
+            at += used;
+            std::vector<float> values;
+            float value;
+            while (sscanf(at, "%f%n", &value, &used) == 1)
+            {
+                values.push_back(value);
+                at += used;
+            }
+            if (strcmp(kind, "circle") == 0 && values.size() == 3 && values[2] > 0)
+                circles.push_back({{values[0], values[1]}, values[2]});
+            else if (strcmp(kind, "polygon") == 0 && values.size() >= 6 && values.size() % 2 == 0)
+            {
+                ObstaclePolygon poly;
+                for (size_t k = 0; k < values.size(); k += 2)
+                    poly.points.push_back({values[k], values[k + 1]});
+                polygons.push_back(poly);
+            }
+            else
+                fprintf(stderr, "%s:%d: not a circle or polygon, skipped\n", path, number);
+        }
+        fclose(file);
+        return true;
+    }
+
+    // removes every shape holding p, returns whether there was one
+    bool RemoveAt(Vector2 p)
+    {
+        size_t before = circles.size() + polygons.size();
+        for (size_t k = circles.size(); k-- > 0;)
+            if (Vector2Distance(p, circles[k].center) <= circles[k].radius)
+                circles.erase(circles.begin() + k);
+        for (size_t k = polygons.size(); k-- > 0;)
+            if (PolygonDistance(p, polygons[k]) <= 0)
+                polygons.erase(polygons.begin() + k);
+        return circles.size() + polygons.size() != before;
+    }
+
+    // exact signed distance to the nearest shape, going through all of them
+    float Distance(Vector2 p) const
+    {
+        float d = INFINITY;
+        for (const ObstacleCircle &c : circles)
+            d = fminf(d, Vector2Distance(p, c.center) - c.radius);
+        for (const ObstaclePolygon &poly : polygons)
+            d = fminf(d, PolygonDistance(p, poly));
+        return d;
+    }
+};
+
+// distance to the nearest obstacle, and the direction in which it grows fastest (not normalized)
+struct DistanceSample
+{
+    float dist;
+    Vector2 grad;
+};
+
+class DistanceField
+{
+  public:
+    float x0 = 0, y0 = 0;   // world position of node (0, 0)
+    float cell = 1;         // node spacing
+    int cols = 0, rows = 0; // nodes per row and per column
+    float range = 0;        // distances are clamped to this
+    std::vector<float> dist;
+
+    // Samples the signed distance to set every `spacing` over the bounding box of the shapes, grown by range
+    void Bake(const ObstacleSet &set, float spacing, float reach)
+    {
+        range = reach;
+        if (set.Empty())
+        {
+            cols = rows = 0;
+            dist.clear();
+            return;
+        }
+        float min_x = INFINITY, min_y = INFINITY, max_x = -INFINITY, max_y = -INFINITY;
+        for (const ObstacleCircle &c : set.circles)
+        {
+            min_x = fminf(min_x, c.center.x - c.radius);
+            min_y = fminf(min_y, c.center.y - c.radius);
+            max_x = fmaxf(max_x, c.center.x + c.radius);
+            max_y = fmaxf(max_y, c.center.y + c.radius);
+        }
+        for (const ObstaclePolygon &poly : set.polygons)
+            for (Vector2 v : poly.points)
+            {
+                min_x = fminf(min_x, v.x);
+                min_y = fminf(min_y, v.y);
+                max_x = fmaxf(max_x, v.x);
+                max_y = fmaxf(max_y, v.y);
+            }
+        x0 = min_x - range;
+        y0 = min_y - range;
+        float w = max_x + range - x0, h = max_y + range - y0;
+        cell = fmaxf(spacing, sqrtf(w * h / SDF_MAX_NODES));
+        cols = (int) ceilf(w / cell) + 1;
+        rows = (int) ceilf(h / cell) + 1;
+        dist.assign((size_t) cols * rows, range);
+
+        for (const ObstacleCircle &c : set.circles)
+            Stamp(c.center.x - c.radius, c.center.y - c.radius, c.center.x + c.radius, c.center.y + c.radius,
+                  [&](Vector2 p) { return Vector2Distance(p, c.center) - c.radius; });
+        for (const ObstaclePolygon &poly : set.polygons)
+        {
+            float left = INFINITY, top = INFINITY, right = -INFINITY, bottom = -INFINITY;
+            for (Vector2 v : poly.points)
+            {
+                left = fminf(left, v.x);
+                top = fminf(top, v.y);
+                right = fmaxf(right, v.x);
+                bottom = fmaxf(bottom, v.y);
+            }
+            Stamp(left, top, right, bottom, [&](Vector2 p) { return PolygonDistance(p, poly); });
+        }
+    }
+
+    bool Empty() const { return dist.empty(); }
+
+    // bilinear distance and its gradient at p, range with no gradient outside of the field
+    DistanceSample Lookup(Vector2 p) const
+    {
+        float fx = (p.x - x0) / cell, fy = (p.y - y0) / cell;
+        if (!(fx >= 0 && fy >= 0 && fx < cols - 1 && fy < rows - 1))
+            return {range, {0, 0}};
+        int x = (int) fx, y = (int) fy;
+        float u = fx - x, v = fy - y;
+        const float *row = dist.data() + (size_t) y * cols + x;
+        float d00 = row[0], d10 = row[1], d01 = row[cols], d11 = row[cols + 1];
+        float top = d00 + (d10 - d00) * u, bottom = d01 + (d11 - d01) * u;
+        Vector2 grad = {((d10 - d00) * (1 - v) + (d11 - d01) * v) / cell, (bottom - top) / cell};
+        return {top + (bottom - top) * v, grad};
+    }
+
+  private:
+    // lowers the nodes within range of the box [left, right] x [top, bottom] to the distance of the shape
+    template <typename Shape> void Stamp(float left, float top, float right, float bottom, Shape &&shape)
+    {
+        int xa = std::max(0, (int) floorf((left - range - x0) / cell));
+        int ya = std::max(0, (int) floorf((top - range - y0) / cell));
+        int xb = std::min(cols - 1, (int) ceilf((right + range - x0) / cell));
+        int yb = std::min(rows - 1, (int) ceilf((bottom + range - y0) / cell));
+        for (int y = ya; y <= yb; y++)
+            for (int x = xa; x <= xb; x++)
+            {
+                float d = shape((Vector2) {x0 + x * cell, y0 + y * cell});
+                float &node = dist[(size_t) y * cols + x];
+                node = fminf(node, fminf(d, range));
+            }
+    }
+};
+
+// Obstacles edited on one thread (the GUI) and baked on the simulation thread, the shapes handed over under a lock
+class ObstacleField
+{
+  public:
+    DistanceField field; // only touched by the simulation thread
+
+    void Set(const ObstacleSet &set)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        pending = set;
+        version++;
+    }
+
+    // Rebakes the field if the shapes changed since the last bake, returns whether it did
+    bool Update(float spacing, float reach)
+    {
+        ObstacleSet set;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (version == baked && spacing == field_spacing && reach == field.range)
+                return false;
+            set = pending;
+            baked = version;
+        }
+        field_spacing = spacing;
+        field.Bake(set, spacing, reach);
+        return true;
+    }
+
+    // version of the shapes baked into field, grows with every Set() baked
+    long long Baked() const { return baked; }
+
+  private:
+    std::mutex lock;
+    ObstacleSet pending;
+    long long version = 0;
+    long long baked = 0;
+    float field_spacing = 0;
+};
+
+#endif // OBSTACLES_H
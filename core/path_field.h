@@ -0,0 +1,263 @@
+/* The way to a goal, shared by the whole flock
+ * Rather than a path per boid, a single Dijkstra search spreads out from the
+ * goal over a grid of nodes, around the nodes the obstacles block, and every
+ * node then points to its neighbour closest to the goal. The directions live
+ * in a FlowGrid (core/flow_field.h), from which a boid reads its way in O(1),
+ * like the wind. When the goal moves (or the obstacles change) the search
+ * starts over, but it is spread over the following steps, a budget of nodes
+ * per step, and the flock follows the previous field until the new one is
+ * complete, so no step pays for a whole search.
+ */
+
+#ifndef PATH_FIELD_H
+#define PATH_FIELD_H
+
+#include <algorithm>
+#include <math.h>
+#include <mutex>
+#include <raymath.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include "flow_field.h"
+#include "obstacles.h"
+
+#define PATH_CELL 20.0f             // node spacing of the path field
+#define PATH_MAX_NODES (256 * 1024) // the node spacing grows past this, for huge worlds
+#define PATH_CLEARANCE 10.0f        // nodes closer than this to an obstacle are blocked
+#define PATH_BUDGET (16 * 1024)     // nodes settled (or pointed) per step
+
+// The goal set on one thread (the GUI) and the field solved on the simulation thread
+class PathField
+{
+  public:
+    FlowGrid field; // unit directions toward the goal of the last complete search, only touched by the simulation thread
+
+    void SetGoal(Vector2 goal)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        pending = goal;
+        has_goal = true;
+    }
+    void ClearGoal()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        has_goal = false;
+    }
+
+    // Moves the search on by at most budget nodes, restarting it first if the goal moved to another node, the world
+    // was resized or the obstacles changed (obstacles_version being ObstacleField::Baked()). Returns the field to
+    // follow, nullptr without a goal or before the first search completes. Only call from one thread.
+    const FlowGrid *Update(const DistanceField *obstacles, long long obstacles_version, float width, float height,
+                           int budget)
+    {
+        Vector2 goal;
+        grew = false;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (!has_goal)
+            {
+                field.v.clear();
+                searching = false;
+                target = -1;
+                return nullptr;
+            }
+            goal = pending;
+        }
+        float spacing = fmaxf(PATH_CELL, sqrtf(width * height / PATH_MAX_NODES));
+        bool resized = spacing != next.cell || next.cols != std::max(2, (int) ceilf(width / spacing) + 1) ||
+                       next.rows != std::max(2, (int) ceilf(height / spacing) + 1);
+        if (resized)
+            Size(width, height, spacing);
+        bool obstacles_changed = obstacles_version != blocked_version;
+        if (resized || obstacles_changed)
+        {
+            Block(obstacles);
+            blocked_version = obstacles_version;
+        }
+        int x = (int) Clamp(roundf((goal.x - next.x0) / next.cell), 0, next.cols - 1);
+        int y = (int) Clamp(roundf((goal.y - next.y0) / next.cell), 0, next.rows - 1);
+        int node = y * next.cols + x;
+        if (resized || obstacles_changed || node != target)
+            Start(node);
+        if (searching && Search(budget))
+        {
+            std::swap(field, next);
+            next.Resize(width, height, spacing); // within the capacity Size() gave both grids
+            searching = false;
+        }
+        return field.v.empty() ? nullptr : &field;
+    }
+
+    bool Searching() const { return searching; }
+    // whether the last Update() had to make room for a larger grid, the only time it allocates
+    bool Grew() const { return grew; }
+
+  private:
+    // Sizes the grid of the next search, and every buffer of the search to its nodes, so that searching, swapping
+    // the grids and sizing the next one again never allocate while the world keeps its size
+    void Size(float width, float height, float spacing)
+    {
+        next.Resize(width, height, spacing);
+        size_t nodes = (size_t) next.cols * next.rows;
+        if (nodes <= capacity)
+            return;
+        next.v.reserve(nodes);
+        field.v.reserve(nodes);
+        blocked.reserve(nodes);
+        cost.reserve(nodes);
+        heap.reserve(nodes);
+        heap_pos.reserve(nodes);
+        capacity = nodes;
+        grew = true;
+    }
+
+    // the nodes too close to an obstacle to pass
+    void Block(const DistanceField *obstacles)
+    {
+        blocked.assign((size_t) next.cols * next.rows, 0);
+        if (!obstacles)
+            return;
+        for (int y = 0; y < next.rows; y++)
+            for (int x = 0; x < next.cols; x++)
+                blocked[(size_t) y * next.cols + x] = obstacles->Lookup(next.Node(x, y)).dist < PATH_CLEARANCE;
+    }
+
+    void Start(int node)
+    {
+        target = node;
+        cost.assign((size_t) next.cols * next.rows, INFINITY);
+        heap_pos.assign((size_t) next.cols * next.rows, -1);
+        heap.clear();
+        cost[node] = 0;
+        Push(node);
+        pointed = 0;
+        searching = true;
+    }
+
+    // Settles, then points, at most budget nodes. Returns true once every node points somewhere.
+    bool Search(int budget)
+    {
+        static const int DX[8] = {1, -1, 0, 0, 1, 1, -1, -1};
+        static const int DY[8] = {0, 0, 1, -1, 1, -1, 1, -1};
+        static const float STEP[8] = {1, 1, 1, 1, 1.41421356f, 1.41421356f, 1.41421356f, 1.41421356f};
+        int cols = next.cols, rows = next.rows;
+        // a diagonal move is only allowed if neither of the side nodes is blocked, not to cut the corner of an obstacle
+        auto open = [&](int x, int y, int d) {
+            int nx = x + DX[d], ny = y + DY[d];
+            if (nx < 0 || ny < 0 || nx >= cols || ny >= rows)
+                return false;
+            return d < 4 || (!blocked[(size_t) y * cols + nx] && !blocked[(size_t) ny * cols + x]);
+        };
+
+        // --- Dijkstra from the goal ---
+        while (budget > 0 && !heap.empty())
+        {
+            int k = Pop();
+            budget--;
+            int x = k % cols, y = k / cols;
+            for (int d = 0; d < 8; d++)
+            {
+                if (!open(x, y, d))
+                    continue;
+                int n = k + DY[d] * cols + DX[d];
+                float c = cost[k] + STEP[d];
+                if (blocked[n] || c >= cost[n])
+                    continue;
+                cost[n] = c;
+                Push(n);
+            }
+        }
+        if (!heap.empty())
+            return false;
+
+        // --- every node points to the neighbour that brings it closest to the goal per unit moved ---
+        // blocked and unreached nodes point to their cheapest neighbour, so boids pushed into one find their way out
+        int total = cols * rows;
+        for (; budget > 0 && pointed < total; pointed++, budget--)
+        {
+            int k = pointed, x = k % cols, y = k / cols;
+            float best = -INFINITY;
+            Vector2 dir = {0, 0};
+            for (int d = 0; d < 8; d++)
+            {
+                if (!open(x, y, d))
+                    continue;
+                int n = k + DY[d] * cols + DX[d];
+                if (cost[n] == INFINITY)
+                    continue;
+                float score = cost[k] < INFINITY ? (cost[k] - cost[n]) / STEP[d] : -cost[n];
+                if (score > best)
+                {
+                    best = score;
+                    dir = (Vector2) {(float) DX[d], (float) DY[d]} * (1.0f / STEP[d]);
+                }
+            }
+            // the goal, or a node no move gets closer from
+            next.v[k] = best > 0 || cost[k] == INFINITY ? dir : (Vector2) {0, 0};
+        }
+        return pointed == total;
+    }
+
+    // --- the frontier, a binary min-heap of nodes by cost which knows where each node sits in it, so a node reached
+    // again for less moves up instead of being pushed twice: it never holds more than every node ---
+    void Push(int node)
+    {
+        if (heap_pos[node] < 0)
+        {
+            heap_pos[node] = (int) heap.size();
+            heap.push_back(node);
+        }
+        int i = heap_pos[node];
+        while (i > 0 && cost[heap[(i - 1) / 2]] > cost[node])
+        {
+            heap[i] = heap[(i - 1) / 2];
+            heap_pos[heap[i]] = i;
+            i = (i - 1) / 2;
+        }
+        heap[i] = node;
+        heap_pos[node] = i;
+    }
+    int Pop()
+    {
+        int top = heap[0], node = heap.back();
+        heap.pop_back();
+        heap_pos[top] = -1;
+        int count = (int) heap.size(), i = 0;
+        if (count == 0)
+            return top;
+        for (int child = 1; child < count; child = 2 * i + 1)
+        {
+            if (child + 1 < count && cost[heap[child + 1]] < cost[heap[child]])
+                child++;
+            if (cost[heap[child]] >= cost[node])
+                break;
+            heap[i] = heap[child];
+            heap_pos[heap[i]] = i;
+            i = child;
+        }
+        heap[i] = node;
+        heap_pos[node] = i;
+        return top;
+    }
+    // --- ---
+
+    std::mutex lock;
+    Vector2 pending = {0, 0};
+    bool has_goal = false;
+
+    FlowGrid next; // being pointed, swapped with field once complete
+    std::vector<uint8_t> blocked;
+    long long blocked_version = -1; // of the obstacles blocked was made from
+    std::vector<float> cost; // distance to the goal along the grid, in node spacings
+    std::vector<int> heap;     // nodes reached but not settled
+    std::vector<int> heap_pos; // index of each node in heap, -1 outside of it
+    size_t capacity = 0;       // nodes every buffer has room for
+    bool grew = false;
+    int target = -1; // node of the goal of the current search
+    int pointed = 0; // nodes whose direction is set
+    bool searching = false;
+};
+
+#endif // PATH_FIELD_H
@@ -0,0 +1,176 @@
+/* Pipelined simulation, for running the flock on its own thread
+ * The render thread hands the frame inputs (mouse position, deltaTime, and the
+ * settings of the tick, see TickParams) to the simulation thread and draws the
+ * latest finished tick, while the simulation thread computes the next one. Both
+ * directions go through lock-free triple buffers, so neither thread ever waits
+ * on the other to read or write data.
+ * The simulation runs at most one tick per rendered frame, as boids move by
+ * their velocity every tick.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "boids_core.h"
+#include "flock_pool.h"
+#include "render_buffer.h"
+#include "triple_buffer.h"
+
+// Everything the renderer needs from one tick
+struct FrameSnapshot
+{
+    long long tick = 0;
+    std::vector<RenderBoid> boids;
+    std::vector<RenderBoid> predators;
+    DensityMap heat; // empty while the heatmap is off
+    double grid_ms = 0.0;
+    double heat_ms = 0.0;
+    int grid_migrated = 0;
+    double tree_ms = 0.0;
+    double hunt_ms = 0.0;
+    double sdf_ms = 0.0;
+    double wind_ms = 0.0;
+    double path_ms = 0.0;
+    double steer_ms = 0.0;
+    double move_ms = 0.0;
+    int steered_boids = 0;
+    int lod_boids[LOD_TIERS] = {0};
+    int capped_boids = 0;
+    long long capped_total = 0;
+    long long capped_frames = 0;
+    double arena_kb = 0.0;
+    double arena_high_water_kb = 0.0;
+    std::vector<double> worker_busy_ms;
+    std::vector<double> worker_idle_ms;
+};
+
+inline void CaptureSnapshot(const FlockPool &flock, long long tick, FrameSnapshot &snap)
+{
+    snap.tick = tick;
+    snap.boids.resize(flock.boids.size());
+    for (size_t i = 0; i < flock.boids.size(); i++)
+        snap.boids[i] = {flock.boids[i].pos, flock.boids[i].vel, flock.color[i]};
+    snap.predators.resize(predator_pack.agents.size());
+    for (size_t p = 0; p < predator_pack.agents.size(); p++)
+        snap.predators[p] = {predator_pack.agents[p].pos, predator_pack.agents[p].vel, PREDATOR_COLOR};
+    snap.heat = flock_density;
+    snap.grid_ms = Stats::grid_ms;
+    snap.heat_ms = Stats::heat_ms;
+    snap.grid_migrated = Stats::grid_migrated;
+    snap.tree_ms = Stats::tree_ms;
+    snap.hunt_ms = Stats::hunt_ms;
+    snap.sdf_ms = Stats::sdf_ms;
+    snap.wind_ms = Stats::wind_ms;
+    snap.path_ms = Stats::path_ms;
+    snap.steer_ms = Stats::steer_ms;
+    snap.move_ms = Stats::move_ms;
+    snap.steered_boids = Stats::steered_boids;
+    memcpy(snap.lod_boids, Stats::lod_boids, sizeof(snap.lod_boids));
+    snap.capped_boids = Stats::capped_boids;
+    snap.capped_total = Stats::capped_total;
+    snap.capped_frames = Stats::capped_frames;
+    snap.arena_kb = Stats::arena_kb;
+    snap.arena_high_water_kb = Stats::arena_high_water_kb;
+    snap.worker_busy_ms = Stats::worker_busy_ms;
+    snap.worker_idle_ms = Stats::worker_idle_ms;
+}
+
+// Owns the simulation thread. While it exists, only that thread touches the flock and the grid,
+// other threads change the flock through its command queue.
+class SimPipeline
+{
+  public:
+    SimPipeline(FlockPool &flock, SpatialGrid &grid, long long tick) : flock(flock), grid(grid), tick(tick)
+    {
+        // so the renderer has the current flock to draw until the first tick lands
+        CaptureSnapshot(flock, tick, output.Back());
+        output.Publish();
+        thread = std::thread(&SimPipeline::Run, this);
+    }
+    ~SimPipeline() { Stop(); }
+    SimPipeline(const SimPipeline &) = delete;
+    SimPipeline &operator=(const SimPipeline &) = delete;
+
+    // render thread, once per frame: ask for the next tick with this frame's inputs
+    void RequestTick(Vector2 mouse_pos, float deltaTime, ViewRect view)
+    {
+        input.Back() = {MakeTickParams(mouse_pos, deltaTime), view};
+        input.Publish();
+        {
+            std::lock_guard<std::mutex> guard(wake_lock);
+            requested++;
+        }
+        wake.notify_one();
+    }
+    // render thread: the most recent finished tick
+    const FrameSnapshot &Latest()
+    {
+        output.Update();
+        return output.Front();
+    }
+    long long Tick() const { return tick.load(std::memory_order_acquire); }
+
+    // waits for the tick in flight, after which the flock belongs to the caller again
+    void Stop()
+    {
+        if (!thread.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> guard(wake_lock);
+            stop = true;
+        }
+        wake.notify_one();
+        thread.join();
+    }
+
+  private:
+    struct FrameInput
+    {
+        TickParams params; // the settings are read on the render thread, which is the one the GUI changes them on
+        ViewRect view;
+    };
+
+    FlockPool &flock;
+    SpatialGrid &grid;
+    std::atomic<long long> tick;
+    TripleBuffer<FrameInput> input;
+    TripleBuffer<FrameSnapshot> output;
+
+    // only used to sleep while there is nothing to do, the data never goes through it
+    std::mutex wake_lock;
+    std::condition_variable wake;
+    long long requested = 0;
+    bool stop = false;
+    std::thread thread;
+
+    void Run()
+    {
+        long long served = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> guard(wake_lock);
+                wake.wait(guard, [&] { return stop || requested != served; });
+                if (stop)
+                    return;
+                // frames that were drawn while the last tick ran are not caught up on
+                served = requested;
+            }
+            input.Update();
+            flock.Apply();
+            StepFlock(flock.boids, grid, input.Front().params, &input.Front().view, flock.species.data());
+            long long now = tick.fetch_add(1, std::memory_order_acq_rel) + 1;
+            CaptureSnapshot(flock, now, output.Back());
+            output.Publish();
+        }
+    }
+};
+
+#endif // PIPELINE_H
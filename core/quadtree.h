@@ -0,0 +1,149 @@
+/* Quadtree over the flock, for the long-range term (Barnes-Hut)
+ * Every node holds the boid count and the sums of positions and velocities of
+ * the boids under it, so that a boid can feel the whole flock in O(log N):
+ * a node that looks small from the boid (side / distance < theta) acts as one
+ * heavy boid at its center of mass, only the nodes close by are opened.
+ * The tree is rebuilt from scratch every step, by splitting the boid indices
+ * in place, quadrant by quadrant.
+ */
+
+#ifndef QUADTREE_H
+#define QUADTREE_H
+
+#include <algorithm>
+#include <math.h>
+#include <raymath.h>
+#include <vector>
+
+#define QT_LEAF 8   // most boids in a leaf
+#define QT_DEPTH 24 // deepest level, boids sharing a position stop there
+
+struct QuadNode
+{
+    float x, y, size; // top left corner and side
+    int begin, end;   // boids under the node are order[begin] .. order[end - 1]
+    int child;        // first of the four children, -1 for a leaf
+    int count;
+    Vector2 pos; // sums over the boids under the node
+    Vector2 vel;
+};
+
+// what a boid feels of the boids far from it, each far boid weighted by 1 / distance
+struct FarField
+{
+    Vector2 toward; // weighted unit vectors toward them
+    Vector2 vel;    // weighted velocities
+    float weight;   // sum of the weights
+};
+
+class Quadtree
+{
+  public:
+    std::vector<QuadNode> nodes; // nodes[0] is the root, the four children of a node are next to each other
+    std::vector<int> order;      // agent indices, grouped by node
+
+    // Rebuild the tree for anything with `pos` and `vel` members, over the square of side max(world_w, world_h)
+    template <typename Agent> void Build(const std::vector<Agent> &agents, float world_w, float world_h)
+    {
+        int n = (int) agents.size();
+        order.resize(n);
+        for (int i = 0; i < n; i++)
+            order[i] = i;
+        nodes.clear();
+        nodes.push_back({0.0f, 0.0f, world_w > world_h ? world_w : world_h, 0, n, -1, 0, {0, 0}, {0, 0}});
+        Split(agents, 0, 0);
+    }
+
+    // What the boid at pos feels of every agent further than `near` from it. A node is taken as a whole when
+    // its side is below theta times its distance and it lies entirely beyond `near`, otherwise it is opened.
+    template <typename Agent> FarField Far(const std::vector<Agent> &agents, Vector2 pos, float near, float theta) const
+    {
+        FarField far = {{0, 0}, {0, 0}, 0.0f};
+        if (nodes.empty())
+            return far;
+        int stack[3 * QT_DEPTH + 4];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const QuadNode &node = nodes[stack[--top]];
+            if (node.count == 0)
+                continue;
+            if (node.child < 0)
+            {
+                for (int k = node.begin; k < node.end; k++)
+                    AddFar(far, agents[order[k]].pos - pos, agents[order[k]].vel, 1, near);
+                continue;
+            }
+            Vector2 center = node.pos * (1.0f / node.count);
+            float d = Vector2Length(center - pos);
+            // the square of the node beyond `near`, not its center of mass, so that no boid of the node is within it
+            float dx = fmaxf(fmaxf(node.x - pos.x, pos.x - (node.x + node.size)), 0.0f);
+            float dy = fmaxf(fmaxf(node.y - pos.y, pos.y - (node.y + node.size)), 0.0f);
+            if (node.size < theta * d && dx * dx + dy * dy > near * near)
+                AddFar(far, center - pos, node.vel * (1.0f / node.count), node.count, near);
+            else
+                for (int q = 0; q < 4; q++)
+                    stack[top++] = node.child + q;
+        }
+        return far;
+    }
+
+  private:
+    template <typename Agent> void Split(const std::vector<Agent> &agents, int n, int depth)
+    {
+        QuadNode node = nodes[n];
+        if (node.end - node.begin <= QT_LEAF || depth >= QT_DEPTH)
+        {
+            Vector2 pos = {0, 0}, vel = {0, 0};
+            for (int k = node.begin; k < node.end; k++)
+            {
+                pos += agents[order[k]].pos;
+                vel += agents[order[k]].vel;
+            }
+            nodes[n].count = node.end - node.begin;
+            nodes[n].pos = pos;
+            nodes[n].vel = vel;
+            return;
+        }
+        // on y first, then both halves on x: top left, top right, bottom left, bottom right
+        float half = node.size / 2;
+        float mx = node.x + half, my = node.y + half;
+        int *first = order.data() + node.begin, *last = order.data() + node.end;
+        int *mid = std::partition(first, last, [&](int i) { return agents[i].pos.y < my; });
+        int *top_mid = std::partition(first, mid, [&](int i) { return agents[i].pos.x < mx; });
+        int *bottom_mid = std::partition(mid, last, [&](int i) { return agents[i].pos.x < mx; });
+        int bounds[5] = {node.begin, (int) (top_mid - order.data()), (int) (mid - order.data()),
+                         (int) (bottom_mid - order.data()), node.end};
+
+        int child = (int) nodes.size();
+        nodes[n].child = child;
+        for (int q = 0; q < 4; q++)
+            nodes.push_back({node.x + (q & 1) * half, node.y + (q >> 1) * half, half, bounds[q], bounds[q + 1], -1, 0,
+                             {0, 0}, {0, 0}});
+        Vector2 pos = {0, 0}, vel = {0, 0};
+        for (int q = 0; q < 4; q++)
+        {
+            Split(agents, child + q, depth + 1);
+            pos += nodes[child + q].pos;
+            vel += nodes[child + q].vel;
+        }
+        nodes[n].count = node.end - node.begin;
+        nodes[n].pos = pos;
+        nodes[n].vel = vel;
+    }
+
+    // count boids at offset diff, moving at vel on average
+    static void AddFar(FarField &far, Vector2 diff, Vector2 vel, int count, float near)
+    {
+        float d = Vector2Length(diff);
+        if (d <= near)
+            return;
+        float w = count / d;
+        far.toward += diff * (w / d);
+        far.vel += vel * w;
+        far.weight += w;
+    }
+};
+
+#endif // QUADTREE_H
@@ -0,0 +1,90 @@
+/* Triangles of the boids in view, rebuilt by the renderer every frame
+ * The simulation only keeps positions and velocities; what the renderer gets
+ * from a tick is a copy of those (plus colors), and the triangles are made
+ * from it for the boids inside the camera view only, into buffers that are
+ * reused from frame to frame.
+ */
+
+#ifndef RENDER_BUFFER_H
+#define RENDER_BUFFER_H
+
+#include <raymath.h>
+#include <vector>
+
+#include "boids_core.h"
+#include "flock_pool.h"
+
+// vertices in clock-wise order
+typedef struct triangle_vertices
+{
+    Vector2 v1;
+    Vector2 v2;
+    Vector2 v3;
+} Triangle;
+
+// what the renderer needs of one boid
+struct RenderBoid
+{
+    Vector2 pos;
+    Vector2 vel;
+    BoidColor color;
+};
+
+// color of the predators, whatever the species
+inline const BoidColor PREDATOR_COLOR = {230, 41, 55, 255};
+
+#define HEAT_FULL 0.004f // boids per square unit drawn at full heat, about 10 in a cell of the default perception radius
+
+// triangle pointing along the velocity, size from center to vertices
+inline Triangle BoidTriangle(Vector2 pos, Vector2 vel, float size = TRI_DIM)
+{
+    Triangle t;
+    Vector2 dir = Vector2Scale(Vector2Normalize(vel), size);
+    t.v1 = pos + dir;
+    dir = Vector2Rotate(dir, 120 * DEG2RAD);
+    t.v2 = pos + dir;
+    dir = Vector2Rotate(dir, 120 * DEG2RAD);
+    t.v3 = pos + dir;
+    return t;
+}
+
+// heat color of a density, from transparent blue when empty to opaque red past HEAT_FULL
+inline BoidColor HeatColor(float density)
+{
+    float t = fminf(density / HEAT_FULL, 1.0f);
+    return {(unsigned char) (255 * t), (unsigned char) (64 * t), (unsigned char) (255 * (1 - t)),
+            (unsigned char) (200 * sqrtf(t))};
+}
+
+class RenderBuffer
+{
+  public:
+    std::vector<Triangle> triangles;
+    std::vector<BoidColor> colors;
+    std::vector<BoidColor> heat; // one pixel per cell of the density map, row by row, for a texture
+
+    // triangles of the boids whose triangle can touch the view rectangle [view_min, view_max]
+    void Build(const std::vector<RenderBoid> &boids, Vector2 view_min, Vector2 view_max)
+    {
+        triangles.clear();
+        colors.clear();
+        for (const RenderBoid &b : boids)
+        {
+            if (b.pos.x < view_min.x - TRI_DIM || b.pos.x > view_max.x + TRI_DIM || b.pos.y < view_min.y - TRI_DIM ||
+                b.pos.y > view_max.y + TRI_DIM)
+                continue;
+            triangles.push_back(BoidTriangle(b.pos, b.vel));
+            colors.push_back(b.color);
+        }
+    }
+
+    // pixels of the density map, empty when the map is
+    void BuildHeat(const DensityMap &map)
+    {
+        heat.resize(map.density.size());
+        for (size_t c = 0; c < map.density.size(); c++)
+            heat[c] = HeatColor(map.density[c]);
+    }
+};
+
+#endif // RENDER_BUFFER_H
@@ -0,0 +1,97 @@
+/* Steering rules fused into a single pass over the neighbours
+ * A rule is a small struct that lives for the steering of one boid:
+ *
+ *     struct Rule
+ *     {
+ *         // the weights and flags of the step it needs, from its parameter block
+ *         explicit Rule(const Params &p);
+ *         // every neighbour in perception range, j its index, diff = self.pos - other.pos, d2 its squared length
+ *         template <typename Agent> void Gather(const Agent &other, int j, Vector2 diff, float d2);
+ *         // the weighted force of the rule once every neighbour was gathered, count of them
+ *         template <typename Agent> Vector2 Force(const Agent &self, int count);
+ *
+ *         // for the gathers from cell sums, whether the rule is exact from the sums of a cell
+ *         static constexpr bool sums;
+ *         // if so, count neighbours at once from their sums of positions and velocities
+ *         void GatherCell(int count, Vector2 sum_pos, Vector2 sum_vel);
+ *         // if not, count neighbours as one at their center of mass, diff and d2 as for Gather()
+ *         void GatherMass(int count, Vector2 diff, float d2);
+ *     };
+ *
+ * RulePipeline<Rules...> holds one of each and forwards every neighbour to all
+ * of them, so a new behaviour adds work to the neighbour loop that already
+ * runs instead of a pass of its own. Everything is resolved at compile time;
+ * a rule that needs no neighbours leaves Gather() empty. Rules that need more
+ * than the neighbours and the parameters (e.g. per-boid data kept apart) get
+ * it through a constructor of their own, and are handed to the pipeline built.
+ * The gathers from cell sums go through the same rules: a cell summed as a
+ * whole goes to the rules that are exact from sums, and either its boids one
+ * by one (GatherUnsummed()) or its center of mass (GatherMass()) to the others.
+ */
+
+#ifndef RULE_PIPELINE_H
+#define RULE_PIPELINE_H
+
+#include <raymath.h>
+#include <tuple>
+
+template <typename... Rules> class RulePipeline
+{
+  public:
+    // every rule made from the parameters of the step
+    template <typename Params> explicit RulePipeline(const Params &p) : rules(Rules(p)...) {}
+    explicit RulePipeline(const Rules &...rule) : rules(rule...) {}
+
+    template <typename Agent> void Gather(const Agent &other, int j, Vector2 diff, float d2)
+    {
+        std::apply([&](Rules &...rule) { (rule.Gather(other, j, diff, d2), ...); }, rules);
+    }
+    // a cell of count neighbours by its sums, for the rules exact from sums; its boids then go to GatherUnsummed()
+    void GatherCell(int count, Vector2 sum_pos, Vector2 sum_vel)
+    {
+        std::apply([&](Rules &...rule) { (CellTo(rule, count, sum_pos, sum_vel), ...); }, rules);
+    }
+    // a neighbour of a cell given to GatherCell(), for the rules that are not exact from sums
+    template <typename Agent> void GatherUnsummed(const Agent &other, int j, Vector2 diff, float d2)
+    {
+        std::apply([&](Rules &...rule) { (UnsummedTo(rule, other, j, diff, d2), ...); }, rules);
+    }
+    // a cell of count neighbours by its sums alone, diff and d2 toward its center of mass: the rules exact from sums
+    // take the sums, the others a single neighbour of weight count at the center of mass
+    void GatherMass(int count, Vector2 sum_pos, Vector2 sum_vel, Vector2 diff, float d2)
+    {
+        std::apply([&](Rules &...rule) { (MassTo(rule, count, sum_pos, sum_vel, diff, d2), ...); }, rules);
+    }
+    // sum of the forces, in the order of Rules
+    template <typename Agent> Vector2 Force(const Agent &self, int count)
+    {
+        Vector2 force = {0, 0};
+        std::apply([&](Rules &...rule) { ((force += rule.Force(self, count)), ...); }, rules);
+        return force;
+    }
+
+  private:
+    template <typename Rule> static void CellTo(Rule &rule, int count, Vector2 sum_pos, Vector2 sum_vel)
+    {
+        if constexpr (Rule::sums)
+            rule.GatherCell(count, sum_pos, sum_vel);
+    }
+    template <typename Rule, typename Agent>
+    static void UnsummedTo(Rule &rule, const Agent &other, int j, Vector2 diff, float d2)
+    {
+        if constexpr (!Rule::sums)
+            rule.Gather(other, j, diff, d2);
+    }
+    template <typename Rule>
+    static void MassTo(Rule &rule, int count, Vector2 sum_pos, Vector2 sum_vel, Vector2 diff, float d2)
+    {
+        if constexpr (Rule::sums)
+            rule.GatherCell(count, sum_pos, sum_vel);
+        else
+            rule.GatherMass(count, diff, d2);
+    }
+
+    std::tuple<Rules...> rules;
+};
+
+#endif // RULE_PIPELINE_H
@@ -0,0 +1,390 @@
+/* Uniform grid over the world, used for neighbour lookup
+ * The grid is rebuilt every frame with a counting sort, so that the boids of
+ * one cell sit next to each other in `items`. Cell size is the perception
+ * radius, so every neighbour of a boid lies in the 3x3 block around its cell
+ * (smaller cells are walked with ForEachCellInRadius()).
+ * In incremental mode, cells are linked lists instead, kept from frame to
+ * frame, and only the boids that changed cell are moved.
+ * The scratch of a build comes from the frame arena, so a build must not
+ * straddle a frame_arena.Reset().
+ */
+
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include <algorithm>
+#include <math.h>
+#include <raymath.h>
+#include <vector>
+
+#include "frame_arena.h"
+
+#define RADIX_BITS 11 // widest digit of the parallel sort, grids of up to 2048 cells sort in a single pass
+
+class SpatialGrid
+{
+  public:
+    float cell_size = 1.0f;
+    float origin_x = 0.0f; // world position of the top left corner of cell 0
+    float origin_y = 0.0f;
+    int cols = 0;
+    int rows = 0;
+    std::vector<int> cell_start; // boids of cell c are items[cell_start[c]] .. items[cell_start[c + 1] - 1]
+    std::vector<int> items;      // boid indices, sorted by cell
+    int agent_count = 0;
+    int builds = 0;            // since the grid was made
+    int *agent_cell = nullptr; // cell of every boid, cached between the count and scatter pass, in the frame arena
+
+    // incremental mode, used instead of cell_start/items while `linked` is set
+    bool linked = false;
+    int migrated = 0;            // agents linked into another cell by the last Relink(), new agents included
+    std::vector<int> head;       // first agent of every cell, -1 when empty
+    std::vector<int> next, prev; // neighbours of an agent in the list of its cell, -1 at the ends
+    std::vector<int> cell_of;    // cell whose list holds the agent
+    std::vector<int> cell_count; // agents in the list of every cell
+
+    int CellX(float x) const
+    {
+        int cx = (int) ((x - origin_x) / cell_size);
+        return cx < 0 ? 0 : (cx >= cols ? cols - 1 : cx);
+    }
+    int CellY(float y) const
+    {
+        int cy = (int) ((y - origin_y) / cell_size);
+        return cy < 0 ? 0 : (cy >= rows ? rows - 1 : cy);
+    }
+    int CellOf(Vector2 p) const { return CellY(p.y) * cols + CellX(p.x); }
+    // agents in cell c, in either mode
+    int CellCount(int c) const { return linked ? cell_count[c] : cell_start[c + 1] - cell_start[c]; }
+
+    // Rebuild the cell lists for anything with a `pos` member
+    template <typename Agent> void Build(const std::vector<Agent> &agents, float world_w, float world_h, float cell)
+    {
+        Resize(world_w, world_h, cell, (int) agents.size());
+        AssignCells(agents, 0, (int) agents.size());
+        Sort();
+    }
+
+    // The build in three stages, so that the per-agent stage can be run over chunks in parallel:
+    // Resize() once, AssignCells() over every agent, then Sort() or SortParallel().
+    // The grid covers world_w x world_h from (x0, y0), agents outside of it land in the border cells.
+    void Resize(float world_w, float world_h, float cell, int count, float x0 = 0.0f, float y0 = 0.0f)
+    {
+        // the lists of the incremental mode only survive a build on the same cells
+        if (cell != cell_size || x0 != origin_x || y0 != origin_y || (int) ceilf(world_w / cell) != cols ||
+            (int) ceilf(world_h / cell) != rows)
+            linked = false;
+        cell_size = cell;
+        origin_x = x0;
+        origin_y = y0;
+        cols = (int) ceilf(world_w / cell);
+        rows = (int) ceilf(world_h / cell);
+        cell_start.resize(cols * rows + 1);
+        items.resize(count);
+        agent_count = count;
+        agent_cell = frame_arena.Alloc<int>(count);
+        builds++;
+    }
+    // room for `count` agents up front, so that a growing flock doesn't reallocate the grid mid run
+    void Reserve(int count) { items.reserve(count); }
+    template <typename Agent> void AssignCells(const std::vector<Agent> &agents, int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+            agent_cell[i] = CellOf(agents[i].pos);
+    }
+    void Sort()
+    {
+        int count = agent_count;
+        linked = false;
+        std::fill(cell_start.begin(), cell_start.end(), 0);
+
+        // count boids per cell, shifted by one so the scan below yields start offsets
+        for (int i = 0; i < count; i++)
+            cell_start[agent_cell[i] + 1]++;
+        for (int c = 0; c < cols * rows; c++)
+            cell_start[c + 1] += cell_start[c];
+
+        // scatter, using cell_start as a running cursor and shifting it back afterwards
+        for (int i = 0; i < count; i++)
+            items[cell_start[agent_cell[i]]++] = i;
+        for (int c = cols * rows; c > 0; c--)
+            cell_start[c] = cell_start[c - 1];
+        cell_start[0] = 0;
+    }
+
+    // Same result as Sort(), built by `blocks` workers without any atomics: a stable LSD radix sort of
+    // the agents on their cell index. Each pass gives every block its own histogram of digit counts over
+    // its slice of agents, turns the histograms into scatter offsets with a parallel exclusive scan, and
+    // scatters, every block writing only to its own offsets. When the grid fits in one digit, that is a
+    // single counting sort with one cell histogram per block.
+    // run(n, fn) must call fn(b) for every b in [0, n), possibly in parallel.
+    template <typename Run> void SortParallel(int blocks, Run &&run)
+    {
+        int count = agent_count;
+        linked = false;
+        int cells = cols * rows;
+        int bits = 0;
+        while ((1 << bits) < cells)
+            bits++;
+        int passes = bits > RADIX_BITS ? (bits + RADIX_BITS - 1) / RADIX_BITS : 1;
+        int digit_bits = (bits + passes - 1) / passes;
+        int bins = 1 << digit_bits;
+        if (blocks < 1)
+            blocks = 1;
+
+        int *histogram = frame_arena.Alloc<int>(blocks * bins); // a row of digit counts per block, then offsets
+        int *partial = frame_arena.Alloc<int>(blocks + 1);       // per block sums for the parallel scan
+        int *keys = frame_arena.Alloc<int>(count);
+        int *keys_tmp = frame_arena.Alloc<int>(count);
+        // the passes swap between two item buffers, start in the one that makes the last pass land in items
+        int *items_a = items.data(), *items_b = frame_arena.Alloc<int>(count);
+        if (passes % 2)
+            std::swap(items_a, items_b);
+        int *sorted = items_a, *sorted_tmp = items_b;
+        run(blocks, [&](int b) {
+            for (int i = count * (long long) b / blocks; i < count * (long long) (b + 1) / blocks; i++)
+            {
+                keys[i] = agent_cell[i];
+                sorted[i] = i;
+            }
+        });
+
+        for (int pass = 0; pass < passes; pass++)
+        {
+            int shift = pass * digit_bits;
+            // per block histograms
+            run(blocks, [&](int b) {
+                int *hist = &histogram[b * bins];
+                std::fill(hist, hist + bins, 0);
+                for (int i = count * (long long) b / blocks; i < count * (long long) (b + 1) / blocks; i++)
+                    hist[(keys[i] >> shift) & (bins - 1)]++;
+            });
+            // exclusive scan over (digit, block) in digit-major order, split in digit ranges:
+            // every block sums its range, the block sums are scanned, then every block writes its offsets
+            run(blocks, [&](int b) {
+                int sum = 0;
+                for (int d = bins * b / blocks; d < bins * (b + 1) / blocks; d++)
+                    for (int k = 0; k < blocks; k++)
+                        sum += histogram[k * bins + d];
+                partial[b + 1] = sum;
+            });
+            partial[0] = 0;
+            for (int b = 0; b < blocks; b++)
+                partial[b + 1] += partial[b];
+            run(blocks, [&](int b) {
+                int offset = partial[b];
+                for (int d = bins * b / blocks; d < bins * (b + 1) / blocks; d++)
+                    for (int k = 0; k < blocks; k++)
+                    {
+                        int n = histogram[k * bins + d];
+                        histogram[k * bins + d] = offset;
+                        offset += n;
+                    }
+            });
+            // stable scatter, each block into the slots reserved for it
+            run(blocks, [&](int b) {
+                int *offset = &histogram[b * bins];
+                for (int i = count * (long long) b / blocks; i < count * (long long) (b + 1) / blocks; i++)
+                {
+                    int slot = offset[(keys[i] >> shift) & (bins - 1)]++;
+                    keys_tmp[slot] = keys[i];
+                    sorted_tmp[slot] = sorted[i];
+                }
+            });
+            std::swap(keys, keys_tmp);
+            std::swap(sorted, sorted_tmp);
+        }
+
+        // cell c starts at the first sorted agent whose cell is >= c; each cell is written by exactly one agent
+        run(blocks, [&](int b) {
+            int first = count * (long long) b / blocks, last = count * (long long) (b + 1) / blocks;
+            for (int i = first; i < last; i++)
+            {
+                int prev = i == 0 ? -1 : keys[i - 1];
+                for (int c = prev + 1; c <= keys[i]; c++)
+                    cell_start[c] = i;
+            }
+            if (b == blocks - 1)
+                for (int c = count ? keys[count - 1] + 1 : 0; c <= cells; c++)
+                    cell_start[c] = count;
+        });
+    }
+
+    // Incremental alternative to the sorts: moves the agents whose cell changed since the last Relink() into
+    // the list of their new cell, links new agents and unlinks the ones past the new count. Rebuilds every list
+    // when the cells changed, or after a sort. Costs a compare per agent, plus the moves.
+    void Relink()
+    {
+        int count = agent_count;
+        int old = linked ? (int) cell_of.size() : 0;
+        if (!linked)
+        {
+            head.assign(cols * rows, -1);
+            cell_count.assign(cols * rows, 0);
+        }
+        for (int i = count; i < old; i++)
+            Unlink(i);
+        next.resize(count);
+        prev.resize(count);
+        cell_of.resize(count);
+        migrated = 0;
+        for (int i = 0; i < count; i++)
+        {
+            if (i < old && agent_cell[i] == cell_of[i])
+                continue;
+            if (i < old)
+                Unlink(i);
+            Link(i, agent_cell[i]);
+            migrated++;
+        }
+        linked = true;
+    }
+
+    // Walking the agents of cell c in one mode, for the hot loops:
+    // for (k = CellBegin<L>(c); k != CellEnd<L>(c); k = CellNext<L>(k)) agent = CellAgent<L>(k)
+    template <bool Linked> int CellBegin(int c) const { return Linked ? head[c] : cell_start[c]; }
+    template <bool Linked> int CellEnd(int c) const { return Linked ? -1 : cell_start[c + 1]; }
+    template <bool Linked> int CellNext(int k) const { return Linked ? next[k] : k + 1; }
+    template <bool Linked> int CellAgent(int k) const { return Linked ? k : items[k]; }
+
+    // Calls visit(agent) for the agents of cell c, in either mode, until it returns false
+    template <typename Visit> void ForEachInCell(int c, Visit &&visit) const
+    {
+        if (linked)
+        {
+            for (int j = head[c]; j >= 0; j = next[j])
+                if (!visit(j))
+                    return;
+        }
+        else
+        {
+            for (int k = cell_start[c]; k < cell_start[c + 1]; k++)
+                if (!visit(items[k]))
+                    return;
+        }
+    }
+
+    // Writes the cells of the 3x3 block around p that come within radius of p into out (at most 9),
+    // ordered nearest-first by distance from p to the cell rectangle. Returns how many were written.
+    int NearbyCells(Vector2 p, float radius, int out[9]) const
+    {
+        float dist[9];
+        int n = 0;
+        int cx = CellX(p.x), cy = CellY(p.y);
+        for (int y = cy - 1; y <= cy + 1; y++)
+        {
+            if (y < 0 || y >= rows)
+                continue;
+            for (int x = cx - 1; x <= cx + 1; x++)
+            {
+                if (x < 0 || x >= cols)
+                    continue;
+                float left = origin_x + x * cell_size, top = origin_y + y * cell_size;
+                float dx = fmaxf(0.0f, fmaxf(left - p.x, p.x - (left + cell_size)));
+                float dy = fmaxf(0.0f, fmaxf(top - p.y, p.y - (top + cell_size)));
+                float d2 = dx * dx + dy * dy;
+                if (d2 >= radius * radius)
+                    continue;
+                // insertion sort, the list is never longer than 9
+                int k = n++;
+                while (k > 0 && dist[k - 1] > d2)
+                {
+                    dist[k] = dist[k - 1];
+                    out[k] = out[k - 1];
+                    k--;
+                }
+                dist[k] = d2;
+                out[k] = y * cols + x;
+            }
+        }
+        return n;
+    }
+
+    // Calls visit(c, full) for every cell that comes within radius of p, whatever the cell size,
+    // with full set when the whole cell lies within radius
+    template <typename Visit> void ForEachCellInRadius(Vector2 p, float radius, Visit &&visit) const
+    {
+        int span = (int) ceilf(radius / cell_size);
+        int cx = CellX(p.x), cy = CellY(p.y);
+        float r2 = radius * radius;
+        for (int y = std::max(cy - span, 0); y <= std::min(cy + span, rows - 1); y++)
+        {
+            float top = origin_y + y * cell_size;
+            float dy = fmaxf(0.0f, fmaxf(top - p.y, p.y - (top + cell_size)));
+            float fy = fmaxf(fabsf(top - p.y), fabsf(top + cell_size - p.y));
+            for (int x = std::max(cx - span, 0); x <= std::min(cx + span, cols - 1); x++)
+            {
+                float left = origin_x + x * cell_size;
+                float dx = fmaxf(0.0f, fmaxf(left - p.x, p.x - (left + cell_size)));
+                if (dx * dx + dy * dy >= r2)
+                    continue;
+                float fx = fmaxf(fabsf(left - p.x), fabsf(left + cell_size - p.x));
+                visit(y * cols + x, fx * fx + fy * fy < r2);
+            }
+        }
+    }
+
+    // Index of the agent nearest to p and closer than max_dist, -1 if there is none. Walks the cells in square
+    // rings around the cell of p, and stops at the first ring that can't hold anything closer than the best so far.
+    template <typename Agent> int Nearest(const std::vector<Agent> &agents, Vector2 p, float max_dist) const
+    {
+        int best = -1;
+        float best_d2 = max_dist * max_dist;
+        int cx = CellX(p.x), cy = CellY(p.y);
+        int rings = std::min((int) ceilf(max_dist / cell_size), std::max(cols, rows));
+        for (int ring = 0; ring <= rings; ring++)
+        {
+            // every cell of the ring is at least ring - 1 cells away from p
+            float reach = (ring - 1) * cell_size;
+            if (reach > 0 && reach * reach >= best_d2)
+                break;
+            for (int y = cy - ring; y <= cy + ring; y++)
+            {
+                if (y < 0 || y >= rows)
+                    continue;
+                // the top and bottom rows of the ring whole, only both ends of the rows between
+                int step = y == cy - ring || y == cy + ring ? 1 : 2 * ring;
+                for (int x = cx - ring; x <= cx + ring; x += step)
+                {
+                    if (x < 0 || x >= cols)
+                        continue;
+                    ForEachInCell(y * cols + x, [&](int j) {
+                        Vector2 diff = agents[j].pos - p;
+                        float d2 = diff.x * diff.x + diff.y * diff.y;
+                        if (d2 < best_d2)
+                        {
+                            best_d2 = d2;
+                            best = j;
+                        }
+                        return true;
+                    });
+                }
+            }
+        }
+        return best;
+    }
+
+  private:
+    void Link(int i, int c)
+    {
+        prev[i] = -1;
+        next[i] = head[c];
+        if (head[c] >= 0)
+            prev[head[c]] = i;
+        head[c] = i;
+        cell_of[i] = c;
+        cell_count[c]++;
+    }
+    void Unlink(int i)
+    {
+        if (prev[i] >= 0)
+            next[prev[i]] = next[i];
+        else
+            head[cell_of[i]] = next[i];
+        if (next[i] >= 0)
+            prev[next[i]] = prev[i];
+        cell_count[cell_of[i]]--;
+    }
+};
+
+#endif // SPATIAL_GRID_H
@@ -0,0 +1,729 @@
+/* Domain decomposition of the flock over processes
+ * The world is cut into vertical strips, and every strip is simulated by its
+ * own process, which owns the boids whose x falls inside it. Each step, a
+ * strip sends the boids within perception radius of its borders to the
+ * neighbouring strips (halo), computes the steering of its own boids with
+ * those ghosts in its grid, moves them, and hands the boids that crossed a
+ * border to their new strip (migration).
+ * The interior boids, which no ghost can reach, are steered while the halos
+ * are in flight.
+ * Strips talk through links, one per neighbour:
+ * - shared memory: single producer, single consumer byte rings in one POSIX
+ *   shared memory segment, strips are forked processes on one host
+ * - TCP: one socket per pair of neighbours, over loopback between forked
+ *   processes, as a local stand-in for strips on different hosts
+ * - MPI (built with BOIDS_MPI): one rank per strip, started by mpirun
+ */
+
+#ifndef STRIPS_H
+#define STRIPS_H
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#ifdef BOIDS_MPI
+#include <mpi.h>
+#endif
+
+#include "boids_core.h"
+
+#define STRIP_RING_BYTES (4 << 20) // capacity of one ring, messages bigger than this are streamed through it
+
+enum StripSide
+{
+    SIDE_LEFT = 0,
+    SIDE_RIGHT = 1,
+};
+
+enum StripTransport
+{
+    TRANSPORT_SHM,
+    TRANSPORT_TCP,
+    TRANSPORT_MPI,
+};
+
+// what travels between strips, for both ghosts and migrants
+struct BoidRecord
+{
+    Vector2 pos;
+    Vector2 vel;
+    int id; // index in the initial flock, -1 for ghosts
+};
+
+// per strip numbers, summed over all steps
+struct StripStats
+{
+    double compute_ms = 0.0;  // grid, steering and movement
+    double comm_ms = 0.0;     // packing, sending and unpacking halos and migrants, waits included
+    double wait_ms = 0.0;     // part of comm_ms spent waiting on the neighbours with nothing left to compute
+    long long halo_sent = 0;  // ghosts sent
+    long long migrated = 0;   // boids handed to another strip
+    long long bytes_sent = 0; // everything written to the links
+    int owned = 0;            // boids owned after the last step
+};
+
+// --- shared memory links ---
+
+// head and tail of a ring, on their own cache lines as they are written by different processes
+struct RingHeader
+{
+    alignas(64) std::atomic<uint64_t> head; // bytes written so far, only moved by the producer
+    alignas(64) std::atomic<uint64_t> tail; // bytes read so far, only moved by the consumer
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring counters must be lock-free to be shared");
+
+class ShmRing
+{
+  public:
+    RingHeader *header = nullptr;
+    char *data = nullptr;
+
+    // write as much of bytes[0, n) as fits, and return how much that was
+    size_t TryWrite(const char *bytes, size_t n)
+    {
+        uint64_t head = header->head.load(std::memory_order_relaxed);
+        uint64_t tail = header->tail.load(std::memory_order_acquire);
+        size_t room = STRIP_RING_BYTES - (size_t) (head - tail);
+        n = n < room ? n : room;
+        for (size_t done = 0; done < n;)
+        {
+            size_t at = (size_t) ((head + done) % STRIP_RING_BYTES);
+            size_t run = STRIP_RING_BYTES - at < n - done ? STRIP_RING_BYTES - at : n - done;
+            memcpy(data + at, bytes + done, run);
+            done += run;
+        }
+        header->head.store(head + n, std::memory_order_release);
+        return n;
+    }
+    // read up to n bytes that are available, and return how many were read
+    size_t TryRead(char *bytes, size_t n)
+    {
+        uint64_t tail = header->tail.load(std::memory_order_relaxed);
+        uint64_t head = header->head.load(std::memory_order_acquire);
+        size_t ready = (size_t) (head - tail);
+        n = n < ready ? n : ready;
+        for (size_t done = 0; done < n;)
+        {
+            size_t at = (size_t) ((tail + done) % STRIP_RING_BYTES);
+            size_t run = STRIP_RING_BYTES - at < n - done ? STRIP_RING_BYTES - at : n - done;
+            memcpy(bytes + done, data + at, run);
+            done += run;
+        }
+        header->tail.store(tail + n, std::memory_order_release);
+        return n;
+    }
+};
+
+// --- TCP links ---
+
+class SocketChannel
+{
+  public:
+    int fd = -1;
+
+    // a broken link can't be recovered from mid step, the strip process gives up and RunStrips() fails
+    size_t TryWrite(const char *bytes, size_t n)
+    {
+        ssize_t sent = send(fd, bytes, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            return 0;
+        if (sent < 0)
+        {
+            perror("strip link");
+            _exit(1);
+        }
+        return (size_t) sent;
+    }
+    size_t TryRead(char *bytes, size_t n)
+    {
+        ssize_t got = recv(fd, bytes, n, MSG_DONTWAIT);
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            return 0;
+        if (got <= 0)
+        {
+            fprintf(stderr, "strip link closed by the neighbour\n");
+            _exit(1);
+        }
+        return (size_t) got;
+    }
+};
+
+// Listening sockets on loopback, one per strip, opened before forking so that every strip knows the ports
+inline bool OpenListeners(int strips, std::vector<int> &listeners, std::vector<int> &ports)
+{
+    for (int s = 0; s < strips; s++)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0; // any free port
+        socklen_t len = sizeof(addr);
+        if (fd < 0 || bind(fd, (sockaddr *) &addr, sizeof(addr)) != 0 || listen(fd, 2) != 0 ||
+            getsockname(fd, (sockaddr *) &addr, &len) != 0)
+        {
+            if (fd >= 0)
+                close(fd);
+            return false;
+        }
+        listeners.push_back(fd);
+        ports.push_back(ntohs(addr.sin_port));
+    }
+    return true;
+}
+
+// Every strip connects to its right neighbour and accepts its left one, so each pair
+// of neighbours shares exactly one socket, even with 1 or 2 strips.
+inline bool ConnectNeighbours(int strip, const std::vector<int> &listeners, const std::vector<int> &ports,
+                              int fds[2])
+{
+    int strips = (int) listeners.size();
+    int right = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(ports[(strip + 1) % strips]);
+    if (right < 0 || connect(right, (sockaddr *) &addr, sizeof(addr)) != 0)
+        return false;
+    int left = accept(listeners[strip], nullptr, nullptr);
+    if (left < 0)
+        return false;
+    // halos are small and latency bound
+    int on = 1;
+    setsockopt(left, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    setsockopt(right, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    fds[SIDE_LEFT] = left;
+    fds[SIDE_RIGHT] = right;
+    return true;
+}
+
+// One message each way to both neighbours over byte stream channels. The outgoing messages are streamed
+// out while the incoming ones are read, so two strips sending each other more than a channel holds never
+// deadlock. A message is an int count followed by that many records.
+template <typename Channel> class StreamLinks
+{
+  public:
+    Channel out_channel[2], in_channel[2];
+    long long bytes_sent = 0;
+
+    // start the exchange, out and in must stay alive until Poll() returns true
+    void Post(const std::vector<BoidRecord> out[2], std::vector<BoidRecord> in[2])
+    {
+        for (int d = 0; d < 2; d++)
+        {
+            out_count[d] = (int) out[d].size();
+            out_data[d] = (const char *) out[d].data();
+            out_total[d] = sizeof(int) + out[d].size() * sizeof(BoidRecord);
+            in_list[d] = &in[d];
+            in_total[d] = sizeof(int);
+            sent[d] = received[d] = 0;
+            bytes_sent += out_total[d];
+        }
+        Poll();
+    }
+    // moves the exchange along without blocking, returns true once both messages went out and both came in
+    bool Poll()
+    {
+        bool done = true;
+        for (int d = 0; d < 2; d++)
+        {
+            // header first, then the records
+            if (sent[d] < sizeof(int))
+                sent[d] += out_channel[d].TryWrite((const char *) &out_count[d] + sent[d], sizeof(int) - sent[d]);
+            if (sent[d] >= sizeof(int) && sent[d] < out_total[d])
+                sent[d] += out_channel[d].TryWrite(out_data[d] + (sent[d] - sizeof(int)), out_total[d] - sent[d]);
+            if (received[d] < sizeof(int))
+            {
+                received[d] += in_channel[d].TryRead((char *) &in_count[d] + received[d], sizeof(int) - received[d]);
+                if (received[d] == sizeof(int))
+                {
+                    in_list[d]->resize(in_count[d]);
+                    in_total[d] = sizeof(int) + in_count[d] * sizeof(BoidRecord);
+                }
+            }
+            if (received[d] >= sizeof(int) && received[d] < in_total[d])
+                received[d] += in_channel[d].TryRead((char *) in_list[d]->data() + (received[d] - sizeof(int)),
+                                                     in_total[d] - received[d]);
+            done &= sent[d] == out_total[d] && received[d] == in_total[d];
+        }
+        return done;
+    }
+
+  private:
+    int out_count[2] = {0, 0}, in_count[2] = {0, 0};
+    const char *out_data[2] = {nullptr, nullptr};
+    std::vector<BoidRecord> *in_list[2] = {nullptr, nullptr};
+    size_t out_total[2] = {0, 0}, in_total[2] = {0, 0};
+    size_t sent[2] = {0, 0}, received[2] = {0, 0};
+};
+
+// --- MPI links ---
+
+#ifdef BOIDS_MPI
+// The same exchange on MPI: non-blocking sends, and receives posted once the size of the incoming message is
+// known. The tag is the side the message was sent towards, which tells the two neighbours apart when they are
+// the same rank.
+class MpiLinks
+{
+  public:
+    int neighbour[2] = {0, 0};
+    long long bytes_sent = 0;
+
+    void Post(const std::vector<BoidRecord> out[2], std::vector<BoidRecord> in[2])
+    {
+        for (int d = 0; d < 2; d++)
+        {
+            MPI_Isend(out[d].data(), (int) (out[d].size() * sizeof(BoidRecord)), MPI_BYTE, neighbour[d], d,
+                      MPI_COMM_WORLD, &send_request[d]);
+            in_list[d] = &in[d];
+            recv_request[d] = MPI_REQUEST_NULL;
+            receiving[d] = false;
+            bytes_sent += out[d].size() * sizeof(BoidRecord);
+        }
+        Poll();
+    }
+    bool Poll()
+    {
+        for (int d = 0; d < 2; d++)
+        {
+            if (receiving[d])
+                continue;
+            // from the neighbour on side d, which sent it towards its opposite side
+            int ready = 0;
+            MPI_Status status;
+            MPI_Iprobe(neighbour[d], 1 - d, MPI_COMM_WORLD, &ready, &status);
+            if (!ready)
+                continue;
+            int bytes;
+            MPI_Get_count(&status, MPI_BYTE, &bytes);
+            in_list[d]->resize(bytes / sizeof(BoidRecord));
+            MPI_Irecv(in_list[d]->data(), bytes, MPI_BYTE, neighbour[d], 1 - d, MPI_COMM_WORLD, &recv_request[d]);
+            receiving[d] = true;
+        }
+        if (!receiving[0] || !receiving[1])
+            return false;
+        MPI_Request requests[4] = {send_request[0], send_request[1], recv_request[0], recv_request[1]};
+        int done = 0;
+        MPI_Testall(4, requests, &done, MPI_STATUSES_IGNORE);
+        for (int d = 0; d < 2; d++)
+        {
+            send_request[d] = requests[d];
+            recv_request[d] = requests[2 + d];
+        }
+        return done != 0;
+    }
+
+  private:
+    MPI_Request send_request[2], recv_request[2];
+    std::vector<BoidRecord> *in_list[2] = {nullptr, nullptr};
+    bool receiving[2] = {false, false};
+};
+#endif
+
+// --- the strip ---
+
+// The part of the flock owned by one strip, plus the ghosts of its neighbours during a step.
+// Links is one of the link types above.
+template <typename Links> class StripWorker
+{
+  public:
+    int strip = 0;
+    int strips = 1;
+    float x0 = 0.0f, x1 = 0.0f; // owned x range [x0, x1), the last strip also owns x1
+    std::vector<Boid> local;    // owned boids first, ghosts after them while a step runs
+    std::vector<int> ids;       // id of every owned boid
+    StripStats stats;
+
+    StripWorker(Links &links, int strip, int strips) : strip(strip), strips(strips), links(links)
+    {
+        float width = Settings::world_width / strips;
+        x0 = width * strip;
+        x1 = width * (strip + 1);
+    }
+
+    // strips form a ring, so that boids wrapping around the world migrate like any other
+    int Neighbour(int side) const { return side == SIDE_LEFT ? (strip + strips - 1) % strips : (strip + 1) % strips; }
+    int StripOf(float x) const
+    {
+        int s = (int) (x / (Settings::world_width / strips));
+        return s < 0 ? 0 : (s >= strips ? strips - 1 : s);
+    }
+
+    void Adopt(const BoidRecord &r)
+    {
+        Boid b;
+        b.pos = r.pos;
+        b.vel = r.vel;
+        b.acc = {0, 0};
+        local.push_back(b);
+        ids.push_back(r.id);
+    }
+
+    void Step(float deltaTime)
+    {
+        TickParams params = MakeTickParams(NO_MOUSE, deltaTime);
+        float r = params.radius;
+        int owned = (int) ids.size();
+        double compute = 0.0, wait = 0.0;
+
+        // --- halo: boids within reach of a border are ghosts for that neighbour ---
+        // (no wrap around here, as neighbours are never looked up across the world border)
+        double t0 = NowMs();
+        for (int d = 0; d < 2; d++)
+            out[d].clear();
+        // owned boids that are, and are not, ghosts for a neighbour
+        int *border = frame_arena.Alloc<int>(owned), *interior = frame_arena.Alloc<int>(owned);
+        int border_count = 0, interior_count = 0;
+        for (int i = 0; i < owned; i++)
+        {
+            bool ghost = false;
+            if (strip > 0 && local[i].pos.x < x0 + r)
+            {
+                out[SIDE_LEFT].push_back({local[i].pos, local[i].vel, -1});
+                ghost = true;
+            }
+            if (strip < strips - 1 && local[i].pos.x >= x1 - r)
+            {
+                out[SIDE_RIGHT].push_back({local[i].pos, local[i].vel, -1});
+                ghost = true;
+            }
+            if (ghost)
+                border[border_count++] = i;
+            else
+                interior[interior_count++] = i;
+        }
+        stats.halo_sent += out[0].size() + out[1].size();
+        links.Post(out, in);
+
+        // --- interior boids are further than perception radius from any ghost, they steer while the halos travel ---
+        double t1 = NowMs();
+        BuildLocalGrid(owned, params);
+        for (int begin = 0; begin < interior_count; begin += STEER_CHUNK)
+        {
+            int end = begin + STEER_CHUNK < interior_count ? begin + STEER_CHUNK : interior_count;
+            SteerBoids(local, grid, interior + begin, end - begin, params);
+            links.Poll();
+        }
+        double t2 = NowMs();
+        while (!links.Poll())
+            sched_yield();
+        double t3 = NowMs();
+        compute += t2 - t1;
+        wait += t3 - t2;
+
+        // --- border boids, with the ghosts in the grid ---
+        for (int d = 0; d < 2; d++)
+            for (const BoidRecord &g : in[d])
+            {
+                Boid b;
+                b.pos = g.pos;
+                b.vel = g.vel;
+                local.push_back(b);
+            }
+        double t4 = NowMs();
+        BuildLocalGrid((int) local.size(), params);
+        SteerBoids(local, grid, border, border_count, params);
+        local.resize(owned);
+        MoveFlock(local, params);
+        double t5 = NowMs();
+        compute += t5 - t4;
+
+        // --- migration: hand over the boids that left the strip ---
+        for (int d = 0; d < 2; d++)
+            out[d].clear();
+        int kept = 0;
+        for (int i = 0; i < owned; i++)
+        {
+            int s = StripOf(local[i].pos.x);
+            if (s == strip)
+            {
+                local[kept] = local[i];
+                ids[kept++] = ids[i];
+            }
+            else
+                out[s == Neighbour(SIDE_LEFT) ? SIDE_LEFT : SIDE_RIGHT].push_back({local[i].pos, local[i].vel, ids[i]});
+        }
+        local.resize(kept);
+        ids.resize(kept);
+        stats.migrated += out[0].size() + out[1].size();
+        links.Post(out, in);
+        double t6 = NowMs();
+        while (!links.Poll())
+            sched_yield();
+        double t7 = NowMs();
+        wait += t7 - t6;
+        for (int d = 0; d < 2; d++)
+            for (const BoidRecord &m : in[d])
+                Adopt(m);
+        double t8 = NowMs();
+
+        stats.compute_ms += compute;
+        stats.comm_ms += (t8 - t0) - compute;
+        stats.wait_ms += wait;
+        stats.bytes_sent = links.bytes_sent;
+        frame_arena.Reset();
+    }
+
+  private:
+    Links &links;
+    SpatialGrid grid;
+    std::vector<BoidRecord> out[2], in[2];
+
+    // grid over the strip and both halos, of the first `count` boids of local
+    void BuildLocalGrid(int count, const TickParams &p)
+    {
+        float r = p.radius;
+        grid.Resize(x1 - x0 + 2 * r, p.world_height, r, count, x0 - r);
+        grid.AssignCells(local, 0, count);
+        grid.Sort();
+    }
+};
+
+// --- running the strips ---
+
+// Shared memory of a forked run: the rings of the shared memory transport (2 per strip, towards
+// its left and right neighbour), then the final flock, then the stats of every strip
+class StripSegment
+{
+  public:
+    int strips = 0;
+    int boid_count = 0;
+    int rings = 0;
+
+    bool Create(int strip_count, int boids, bool with_rings)
+    {
+        strips = strip_count;
+        boid_count = boids;
+        rings = with_rings ? 2 * strips : 0;
+        size = RingsBytes() + sizeof(BoidRecord) * boids + sizeof(StripStats) * strips;
+        char name[64];
+        snprintf(name, sizeof(name), "/boids_strips_%d", (int) getpid());
+        int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0)
+            return false;
+        // the name is only needed to map it, children inherit the mapping through fork()
+        shm_unlink(name);
+        if (ftruncate(fd, (off_t) size) != 0)
+        {
+            close(fd);
+            return false;
+        }
+        void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mem == MAP_FAILED)
+            return false;
+        base = (char *) mem;
+        for (int r = 0; r < rings; r++)
+        {
+            RingHeader *h = new (base + r * RingStride()) RingHeader;
+            h->head.store(0);
+            h->tail.store(0);
+        }
+        for (int s = 0; s < strips; s++)
+            new (Stats() + s) StripStats;
+        return true;
+    }
+    void Destroy()
+    {
+        if (base)
+            munmap(base, size);
+        base = nullptr;
+    }
+
+    // ring written by `strip` towards its neighbour on `side`
+    ShmRing Ring(int strip, int side)
+    {
+        ShmRing ring;
+        ring.header = (RingHeader *) (base + (2 * strip + side) * RingStride());
+        ring.data = (char *) (ring.header + 1);
+        return ring;
+    }
+    BoidRecord *Flock() { return (BoidRecord *) (base + RingsBytes()); }
+    StripStats *Stats() { return (StripStats *) (base + RingsBytes() + sizeof(BoidRecord) * boid_count); }
+
+  private:
+    char *base = nullptr;
+    size_t size = 0;
+
+    static size_t RingStride() { return sizeof(RingHeader) + STRIP_RING_BYTES; }
+    size_t RingsBytes() const { return rings * RingStride(); }
+};
+
+// Strips must be at least perception_radius + max_speed wide, so that halos and migrants only ever
+// go to the direct neighbours
+inline bool StripsFit(int strip_count)
+{
+    return strip_count >= 1 && Settings::world_width / strip_count >= Settings::perception_radius + Settings::max_speed;
+}
+
+// takes the boids of the initial flock that fall in the strip, and runs `steps` steps
+template <typename Links>
+void RunStrip(StripWorker<Links> &worker, const std::vector<Boid> &boids, int steps, float deltaTime)
+{
+    for (int i = 0; i < (int) boids.size(); i++)
+        if (worker.StripOf(boids[i].pos.x) == worker.strip)
+            worker.Adopt({boids[i].pos, boids[i].vel, i});
+    for (int step = 0; step < steps; step++)
+        worker.Step(deltaTime);
+    worker.stats.owned = (int) worker.ids.size();
+}
+
+template <typename Links> void ReportStrip(StripSegment &segment, const StripWorker<Links> &worker)
+{
+    for (int i = 0; i < (int) worker.ids.size(); i++)
+        segment.Flock()[worker.ids[i]] = {worker.local[i].pos, worker.local[i].vel, worker.ids[i]};
+    segment.Stats()[worker.strip] = worker.stats;
+}
+
+// Runs `steps` steps of the flock split over `strip_count` forked processes, talking over shared memory
+// or TCP loopback. Writes the final flock back into boids (same order as given) and the numbers of every
+// strip into stats. Returns false if the run failed.
+inline bool RunStrips(std::vector<Boid> &boids, int strip_count, StripTransport transport, int steps,
+                      float deltaTime, std::vector<StripStats> &stats)
+{
+    if (!StripsFit(strip_count) || transport == TRANSPORT_MPI)
+        return false;
+    StripSegment segment;
+    if (!segment.Create(strip_count, (int) boids.size(), transport == TRANSPORT_SHM))
+        return false;
+    std::vector<int> listeners, ports;
+    if (transport == TRANSPORT_TCP && !OpenListeners(strip_count, listeners, ports))
+    {
+        for (int fd : listeners)
+            close(fd);
+        segment.Destroy();
+        return false;
+    }
+
+    std::vector<pid_t> children;
+    for (int s = 0; s < strip_count; s++)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+            break;
+        if (pid == 0)
+        {
+            // the pool threads of the parent don't exist in the child, leave that pool alone;
+            // every strip runs single threaded, the processes are the parallelism
+            sim_pool.release();
+            Settings::backend = BACKEND_SERIAL;
+
+            if (transport == TRANSPORT_SHM)
+            {
+                StreamLinks<ShmRing> links;
+                StripWorker<StreamLinks<ShmRing>> worker(links, s, strip_count);
+                for (int d = 0; d < 2; d++)
+                {
+                    links.out_channel[d] = segment.Ring(s, d);
+                    // what the neighbour on side d writes towards us, i.e. towards its opposite side
+                    links.in_channel[d] = segment.Ring(worker.Neighbour(d), 1 - d);
+                }
+                RunStrip(worker, boids, steps, deltaTime);
+                ReportStrip(segment, worker);
+            }
+            else
+            {
+                StreamLinks<SocketChannel> links;
+                int fds[2];
+                if (!ConnectNeighbours(s, listeners, ports, fds))
+                    _exit(1);
+                for (int fd : listeners)
+                    close(fd);
+                for (int d = 0; d < 2; d++)
+                    links.out_channel[d].fd = links.in_channel[d].fd = fds[d];
+                StripWorker<StreamLinks<SocketChannel>> worker(links, s, strip_count);
+                RunStrip(worker, boids, steps, deltaTime);
+                ReportStrip(segment, worker);
+            }
+            // skip the destructors of the parent's globals
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+    for (int fd : listeners)
+        close(fd);
+
+    bool ok = (int) children.size() == strip_count;
+    for (pid_t pid : children)
+    {
+        int status;
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            ok = false;
+    }
+    if (ok)
+    {
+        stats.assign(segment.Stats(), segment.Stats() + strip_count);
+        for (int i = 0; i < (int) boids.size(); i++)
+        {
+            boids[i].pos = segment.Flock()[i].pos;
+            boids[i].vel = segment.Flock()[i].vel;
+        }
+    }
+    segment.Destroy();
+    return ok;
+}
+
+#ifdef BOIDS_MPI
+// Same as RunStrips(), with one MPI rank per strip. Every rank passes the same initial flock, the final
+// flock and the stats are only written on rank 0. MPI must be initialized.
+inline bool RunStripsMpi(std::vector<Boid> &boids, int steps, float deltaTime, std::vector<StripStats> &stats)
+{
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    if (!StripsFit(size))
+        return false;
+
+    MpiLinks links;
+    StripWorker<MpiLinks> worker(links, rank, size);
+    for (int d = 0; d < 2; d++)
+        links.neighbour[d] = worker.Neighbour(d);
+    RunStrip(worker, boids, steps, deltaTime);
+
+    // gather the boids and stats of every strip on rank 0
+    std::vector<BoidRecord> mine(worker.ids.size());
+    for (int i = 0; i < (int) worker.ids.size(); i++)
+        mine[i] = {worker.local[i].pos, worker.local[i].vel, worker.ids[i]};
+    int bytes = (int) (mine.size() * sizeof(BoidRecord));
+    std::vector<int> counts(size), offsets(size);
+    MPI_Gather(&bytes, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+    std::vector<BoidRecord> all;
+    if (rank == 0)
+    {
+        int total = 0;
+        for (int s = 0; s < size; s++)
+        {
+            offsets[s] = total;
+            total += counts[s];
+        }
+        all.resize(total / sizeof(BoidRecord));
+        stats.resize(size);
+    }
+    MPI_Gatherv(mine.data(), bytes, MPI_BYTE, all.data(), counts.data(), offsets.data(), MPI_BYTE, 0,
+                MPI_COMM_WORLD);
+    MPI_Gather(&worker.stats, sizeof(StripStats), MPI_BYTE, stats.data(), sizeof(StripStats), MPI_BYTE, 0,
+               MPI_COMM_WORLD);
+    if (rank == 0)
+        for (const BoidRecord &r : all)
+        {
+            boids[r.id].pos = r.pos;
+            boids[r.id].vel = r.vel;
+        }
+    return true;
+}
+#endif
+
+#endif // STRIPS_H
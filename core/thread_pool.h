@@ -0,0 +1,287 @@
+/* Small work-stealing thread pool for the simulation
+ * ParallelFor() cuts a range into chunks and hands every worker a contiguous
+ * block of them. A worker eats its own block front to back, and once it runs
+ * dry it steals chunks from the back of the other workers' blocks, so a few
+ * crowded grid cells don't leave the rest of the threads waiting.
+ * The calling thread takes part as worker 0. With an affinity it is pinned like
+ * the other workers, but only while it runs a ParallelFor(), since between two
+ * it goes back to being whatever thread called in (e.g. the render thread).
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#endif
+
+// where the pool threads are pinned
+enum ThreadAffinity
+{
+    AFFINITY_NONE = 0, // let the OS place them
+    AFFINITY_COMPACT,  // worker i on cpu i
+    AFFINITY_SCATTER,  // one cpu of every physical core first, to keep workers off each other's SMT sibling
+};
+
+class ThreadPool
+{
+  public:
+    std::vector<double> busy_ms; // per worker, time spent running chunks since ResetStats()
+    double wall_ms = 0.0;        // time spent inside ParallelFor() since ResetStats()
+
+    explicit ThreadPool(int threads, int affinity = AFFINITY_NONE) : affinity(affinity)
+    {
+        if (threads < 1)
+            threads = 1;
+        workers = threads;
+        queues.reset(new Queue[threads]);
+        busy_ms.assign(threads, 0.0);
+        if (affinity == AFFINITY_SCATTER)
+            scatter = ScatterOrder();
+        for (int w = 1; w < threads; w++)
+            threads_.emplace_back(&ThreadPool::WorkerLoop, this, w);
+    }
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(wake_lock);
+            stop = true;
+        }
+        wake.notify_all();
+        for (std::thread &t : threads_)
+            t.join();
+    }
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int Size() const { return workers; }
+    int Affinity() const { return affinity; }
+    double IdleMs(int worker) const { return wall_ms - busy_ms[worker]; }
+    void ResetStats()
+    {
+        busy_ms.assign(workers, 0.0);
+        wall_ms = 0.0;
+    }
+
+    // Calls fn(chunk_begin, chunk_end, worker) over [begin, end) in chunks of grain, and returns once all are done
+    template <typename Fn> void ParallelFor(int begin, int end, int grain, Fn &&fn)
+    {
+        if (begin >= end)
+            return;
+        if (grain < 1)
+            grain = 1;
+        double t0 = Now();
+        int chunks = (end - begin + grain - 1) / grain;
+        if (workers == 1 || chunks == 1)
+        {
+            fn(begin, end, 0);
+            double t1 = Now();
+            busy_ms[0] += t1 - t0;
+            wall_ms += t1 - t0;
+            return;
+        }
+
+        typedef typename std::remove_reference<Fn>::type Body;
+        job_fn = [](void *ctx, int b, int e, int w) { (*(Body *) ctx)(b, e, w); };
+        job_ctx = (void *) &fn;
+        job_begin = begin;
+        job_end = end;
+        job_grain = grain;
+        remaining.store(chunks, std::memory_order_release);
+        for (int w = 0; w < workers; w++)
+        {
+            std::lock_guard<std::mutex> guard(queues[w].lock);
+            queues[w].head = (int) ((long long) chunks * w / workers);
+            queues[w].tail = (int) ((long long) chunks * (w + 1) / workers);
+        }
+        {
+            std::lock_guard<std::mutex> guard(wake_lock);
+            generation++;
+        }
+        wake.notify_all();
+
+        bool pinned = PinCaller();
+        Work(0);
+        while (remaining.load(std::memory_order_acquire) > 0)
+            std::this_thread::yield();
+        if (pinned)
+            UnpinCaller();
+        wall_ms += Now() - t0;
+    }
+
+  private:
+    // chunk indices [head, tail) still waiting in this worker's block
+    struct Queue
+    {
+        std::mutex lock;
+        int head = 0;
+        int tail = 0;
+    };
+
+    int workers = 1;
+    int affinity = AFFINITY_NONE;
+    std::unique_ptr<Queue[]> queues;
+    std::vector<std::thread> threads_;
+    std::vector<int> scatter; // cpus in the order of AFFINITY_SCATTER
+#ifdef __linux__
+    cpu_set_t caller_cpus; // of the calling thread before it was pinned as worker 0
+#endif
+
+    std::mutex wake_lock;
+    std::condition_variable wake;
+    unsigned generation = 0;
+    bool stop = false;
+
+    // the job currently being run, type-erased so no allocation happens per call
+    void (*job_fn)(void *, int, int, int) = nullptr;
+    void *job_ctx = nullptr;
+    int job_begin = 0, job_end = 0, job_grain = 1;
+    std::atomic<int> remaining{0};
+
+    static double Now()
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    bool PopOwn(int w, int *chunk)
+    {
+        std::lock_guard<std::mutex> guard(queues[w].lock);
+        if (queues[w].head >= queues[w].tail)
+            return false;
+        *chunk = queues[w].head++;
+        return true;
+    }
+    bool Steal(int w, int *chunk)
+    {
+        for (int k = 1; k < workers; k++)
+        {
+            Queue &victim = queues[(w + k) % workers];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (victim.head < victim.tail)
+            {
+                *chunk = --victim.tail;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Work(int w)
+    {
+        int chunk;
+        while (PopOwn(w, &chunk) || Steal(w, &chunk))
+        {
+            double t0 = Now();
+            int b = job_begin + chunk * job_grain;
+            int e = b + job_grain < job_end ? b + job_grain : job_end;
+            job_fn(job_ctx, b, e, w);
+            busy_ms[w] += Now() - t0;
+            remaining.fetch_sub(1, std::memory_order_acq_rel);
+        }
+    }
+
+    void WorkerLoop(int w)
+    {
+        Pin(w);
+        unsigned seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> guard(wake_lock);
+                wake.wait(guard, [&] { return stop || generation != seen; });
+                if (stop)
+                    return;
+                seen = generation;
+            }
+            Work(w);
+        }
+    }
+
+    // pins the calling thread as worker 0, returns false if it wasn't
+    bool PinCaller()
+    {
+#ifdef __linux__
+        if (affinity == AFFINITY_NONE || pthread_getaffinity_np(pthread_self(), sizeof(caller_cpus), &caller_cpus))
+            return false;
+        Pin(0);
+        return true;
+#else
+        return false;
+#endif
+    }
+    void UnpinCaller()
+    {
+#ifdef __linux__
+        pthread_setaffinity_np(pthread_self(), sizeof(caller_cpus), &caller_cpus);
+#endif
+    }
+
+    void Pin(int w)
+    {
+#ifdef __linux__
+        int cpus = (int) std::thread::hardware_concurrency();
+        if (affinity == AFFINITY_NONE || cpus < 1)
+            return;
+        int cpu = affinity == AFFINITY_SCATTER && !scatter.empty() ? scatter[w % scatter.size()] : w % cpus;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+        (void) w;
+#endif
+    }
+
+    // Every cpu, the first SMT thread of every physical core before the second ones, and so on, from the sibling
+    // lists of sysfs ("0,8" or "0-1"), which number siblings either next to each other or half the cpus apart.
+    // Empty where those can't be read.
+    static std::vector<int> ScatterOrder()
+    {
+        std::vector<std::pair<int, int>> ranked; // (index of the cpu among its siblings, cpu)
+#ifdef __linux__
+        int cpus = (int) std::thread::hardware_concurrency();
+        for (int cpu = 0; cpu < cpus; cpu++)
+        {
+            char path[96];
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+            FILE *f = fopen(path, "r");
+            if (!f)
+                return {};
+            int rank = 0, first, last;
+            while (fscanf(f, "%d", &first) == 1)
+            {
+                last = first;
+                if (fscanf(f, "-%d", &last) < 0)
+                    last = first;
+                if (cpu >= first && cpu <= last)
+                    rank += cpu - first;
+                else if (last < cpu)
+                    rank += last - first + 1;
+                if (fgetc(f) != ',')
+                    break;
+            }
+            fclose(f);
+            ranked.push_back({rank, cpu});
+        }
+#endif
+        std::sort(ranked.begin(), ranked.end());
+        std::vector<int> order;
+        for (const std::pair<int, int> &r : ranked)
+            order.push_back(r.second);
+        return order;
+    }
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,38 @@
+/* Lock-free hand-over of the latest value from one thread to another
+ * Shared by the pipelined simulation (frame inputs one way, snapshots the
+ * other) and the flow field generator.
+ */
+
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+// Single producer, single consumer triple buffer. The producer fills Back() and
+// publishes it, the consumer picks up the most recent published slot with Update().
+template <typename T> class TripleBuffer
+{
+  public:
+    T &Back() { return slots[back]; }
+    void Publish() { back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX; }
+
+    // returns true if a newer slot was published since the last call
+    bool Update()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH))
+            return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+    const T &Front() const { return slots[front]; }
+
+  private:
+    static const int INDEX = 3;
+    static const int FRESH = 4;
+    T slots[3];
+    int back = 0;
+    int front = 1;
+    std::atomic<int> middle{2}; // slot index, plus FRESH when the producer wrote it since the consumer last took it
+};
+
+#endif // TRIPLE_BUFFER_H